@@ -67,11 +67,277 @@ private:
 	std::function<double(double)> transitionFunc;
 };
 
+// イージング関数を標本化しておき、線形補間で引く
+class EasingTable
+{
+public:
+
+	static constexpr size_t Resolution = 256;
+
+	// EaseOutCirc などの関数ポインタは関数ごとに一度だけ標本化して共有する。ラムダなどは毎回標本化する
+	static std::shared_ptr<const EasingTable> Get(const std::function<double(double)>& func)
+	{
+		using Function = double(*)(double);
+		const Function* pFunction = func.target<Function>();
+		if (!pFunction)
+		{
+			return std::make_shared<const EasingTable>(func);
+		}
+
+		static std::vector<std::pair<Function, std::shared_ptr<const EasingTable>>> tables;
+		for (const auto& table : tables)
+		{
+			if (table.first == *pFunction)
+			{
+				return table.second;
+			}
+		}
+		tables.emplace_back(*pFunction, std::make_shared<const EasingTable>(func));
+		return tables.back().second;
+	}
+
+	explicit EasingTable(const std::function<double(double)>& func)
+	{
+		for (size_t i = 0; i <= Resolution; ++i)
+		{
+			values[i] = func(1.0 * i / Resolution);
+		}
+	}
+
+	double operator()(double progress)const
+	{
+		const double x = Clamp(progress, 0.0, 1.0) * Resolution;
+		const size_t i = Min(static_cast<size_t>(x), Resolution - 1);
+		return Math::Lerp(values[i], values[i + 1], x - i);
+	}
+
+private:
+
+	std::array<double, Resolution + 1> values;
+};
+
+template<class T>
+class KeyframeTrack
+{
+public:
+
+	// time の時点で value になるように、直前のキーフレームから easing で補間する
+	void add(double time, const T& value, std::function<double(double)> easing = EaseOutCirc)
+	{
+		const auto it = std::upper_bound(keyframes.begin(), keyframes.end(), time, [](double t, const Keyframe& keyframe) { return t < keyframe.time; });
+		keyframes.insert(it, Keyframe{ time, value, EasingTable::Get(easing) });
+	}
+
+	// other のキーフレームを offset だけ遅らせて後ろに繋げる
+	// offset より前に終わるトラックは、offset まで最後の値を保ってから other に移る
+	void append(const KeyframeTrack& other, double offset)
+	{
+		if (!keyframes.empty() && keyframes.back().time < offset)
+		{
+			keyframes.push_back(Keyframe{ offset, keyframes.back().value, keyframes.back().easing });
+		}
+		for (const auto& keyframe : other.keyframes)
+		{
+			keyframes.push_back(Keyframe{ keyframe.time + offset, keyframe.value, keyframe.easing });
+		}
+	}
+
+	bool isEmpty()const { return keyframes.empty(); }
+
+	double endTime()const { return keyframes.empty() ? 0.0 : keyframes.back().time; }
+
+	T sample(double time)const
+	{
+		const auto it = std::upper_bound(keyframes.begin(), keyframes.end(), time, [](double t, const Keyframe& keyframe) { return t < keyframe.time; });
+		if (it == keyframes.begin())
+		{
+			return keyframes.front().value;
+		}
+		if (it == keyframes.end())
+		{
+			return keyframes.back().value;
+		}
+
+		const Keyframe& from = *(it - 1);
+		const Keyframe& to = *it;
+		const double progress = (time - from.time) / (to.time - from.time);
+		return Math::Lerp(from.value, to.value, (*to.easing)(progress));
+	}
+
+private:
+
+	struct Keyframe
+	{
+		double time;
+		T value;
+		std::shared_ptr<const EasingTable> easing;
+	};
+
+	std::vector<Keyframe> keyframes;
+};
+
+class QuarterLayer;
+class QuarterView;
+class QuarterLayerPtr;
+
+// レイヤーの位置・高さ・スケールのキーフレームアニメーション
+// 時刻 [秒] を渡して評価するので、同じタイムラインを複数のレイヤーで共有できる
+class QuarterTimeline
+{
+public:
+
+	QuarterTimeline& position(double time, const Vec2& value, std::function<double(double)> easing = EaseOutCirc)
+	{
+		positionTrack.add(time, value, easing);
+		return *this;
+	}
+
+	QuarterTimeline& elevation(double time, double value, std::function<double(double)> easing = EaseOutCirc)
+	{
+		elevationTrack.add(time, value, easing);
+		return *this;
+	}
+
+	QuarterTimeline& scale(double time, const Vec2& value, std::function<double(double)> easing = EaseOutCirc)
+	{
+		scaleTrack.add(time, value, easing);
+		return *this;
+	}
+
+	// other をこのタイムラインの終わりから続けて再生する
+	QuarterTimeline& then(const QuarterTimeline& other)
+	{
+		const double offset = duration();
+		positionTrack.append(other.positionTrack, offset);
+		elevationTrack.append(other.elevationTrack, offset);
+		scaleTrack.append(other.scaleTrack, offset);
+		return *this;
+	}
+
+	double duration()const
+	{
+		return Max(positionTrack.endTime(), Max(elevationTrack.endTime(), scaleTrack.endTime()));
+	}
+
+	void apply(QuarterLayer& layer, double time)const;
+
+	// layers[i] には time + i * stagger の時点の値を設定する
+	void apply(const Array<QuarterLayerPtr>& layers, double time, double stagger = 0.0)const;
+
+	bool loop = false;
+
+private:
+
+	double localTime(double time)const
+	{
+		const double length = duration();
+		if (!loop || length <= 0.0)
+		{
+			return time;
+		}
+		const double t = Math::Fmod(time, length);
+		return t < 0.0 ? t + length : t;
+	}
+
+	// 値が変わらないときは設定しないので、静止区間や再生後のレイヤーは変化したとみなされない
+	static void Set(QuarterLayer& layer, const Optional<Vec2>& position, const Optional<double>& elevation, const Optional<Vec2>& scale);
+
+	KeyframeTrack<Vec2> positionTrack;
+	KeyframeTrack<double> elevationTrack;
+	KeyframeTrack<Vec2> scaleTrack;
+};
+
 enum class LayerType { Z, X, Y };
 enum class LayerAlignPos { TopLeft, TopRight, BottomLeft, BottomRight, LeftCenter, TopCenter, RightCenter, BottomCenter, Center };
 
-class QuarterLayer;
-using QuarterLayerPtr = std::shared_ptr<QuarterLayer>;
+// QuarterView が持つレイヤーを指すハンドル
+// erase() されたレイヤーを指すハンドルは無効になり、isValid() が false を返す
+class QuarterLayerPtr
+{
+public:
+
+	QuarterLayerPtr() = default;
+
+	QuarterLayerPtr(std::nullptr_t) {}
+
+	QuarterLayerPtr& operator=(std::nullptr_t)
+	{
+		*this = QuarterLayerPtr();
+		return *this;
+	}
+
+	void reset() { *this = nullptr; }
+
+	bool isValid()const;
+
+	explicit operator bool()const { return isValid(); }
+
+	// 無効なハンドルの場合は nullptr を返す
+	QuarterLayer* get()const;
+
+	QuarterLayer* operator->()const;
+
+	QuarterLayer& operator*()const;
+
+	bool operator==(const QuarterLayerPtr& other)const
+	{
+		return pQuarterView == other.pQuarterView && slotIndex == other.slotIndex && generation == other.generation;
+	}
+
+	bool operator!=(const QuarterLayerPtr& other)const
+	{
+		return !(*this == other);
+	}
+
+	// 空のハンドルと erase() されたレイヤーを指すハンドルは nullptr と等しい
+	bool operator==(std::nullptr_t)const { return !isValid(); }
+
+	bool operator!=(std::nullptr_t)const { return isValid(); }
+
+	bool operator<(const QuarterLayerPtr& other)const
+	{
+		if (pQuarterView != other.pQuarterView)
+		{
+			return std::less<const QuarterView*>()(pQuarterView, other.pQuarterView);
+		}
+		return slotIndex != other.slotIndex ? slotIndex < other.slotIndex : generation < other.generation;
+	}
+
+private:
+
+	friend class QuarterView;
+	friend struct std::hash<QuarterLayerPtr>;
+
+	QuarterLayerPtr(QuarterView* pQuarterView, uint32 slotIndex, uint32 generation) :
+		pQuarterView(pQuarterView),
+		slotIndex(slotIndex),
+		generation(generation)
+	{}
+
+	QuarterView* pQuarterView = nullptr;
+	uint32 slotIndex = 0;
+	uint32 generation = 0;
+};
+
+inline bool operator==(std::nullptr_t, const QuarterLayerPtr& layer) { return layer == nullptr; }
+
+inline bool operator!=(std::nullptr_t, const QuarterLayerPtr& layer) { return layer != nullptr; }
+
+namespace std
+{
+	template<>
+	struct hash<QuarterLayerPtr>
+	{
+		size_t operator()(const QuarterLayerPtr& layer)const noexcept
+		{
+			const uint64 index = (static_cast<uint64>(layer.slotIndex) << 32) | layer.generation;
+			return hash<const void*>()(layer.pQuarterView) ^ hash<uint64>()(index);
+		}
+	};
+}
+
+class QuarterImpostor;
+using QuarterImpostorPtr = std::shared_ptr<QuarterImpostor>;
 
 class QuarterView
 {
@@ -81,24 +347,71 @@ public:
 
 	QuarterView(const Vec2& origin) :origin(origin) {}
 
+	// layerSource のレイヤーを共有して別の視点から描画する
+	// レイヤーの render() と resolve はすべての視点で1回で済み、視点ごとには合成だけを行う
+	QuarterView(QuarterView& layerSource, const Vec2& origin) :
+		origin(origin),
+		pLayerSource(&layerSource.owner())
+	{
+		pLayerSource->sharingViews.push_back(this);
+	}
+
+	~QuarterView()
+	{
+		if (pLayerSource)
+		{
+			auto& views = pLayerSource->sharingViews;
+			views.erase(std::remove(views.begin(), views.end(), this), views.end());
+		}
+	}
+
+	// レイヤーとハンドル、共有する視点がこの QuarterView のアドレスを持つのでコピーできない
+	QuarterView(const QuarterView&) = delete;
+	QuarterView& operator=(const QuarterView&) = delete;
+
 	void update();
 
+	// このフレームの描画順を作る。draw() と drawPartial() はこれを切り出して描画する
+	// 呼ばなければ update() 後の最初の draw() か drawPartial() で作られる
+	void beginFrame();
+
 	void draw();
 	void drawPartial(int32 beginGroupIndex, size_t drawGroupCount = -1);
 
 	void resolve();
 
-	QuarterLayerPtr newLayer(const Size& resolution, LayerType type = LayerType::Z, double elevation = 0.0, const Vec2& position = Vec2::Zero())
-	{
-		layers.push_back(std::make_shared<QuarterLayer>(*this, type, resolution, position, elevation, Vec2::One()));
-		return layers.back();
-	}
+	QuarterLayerPtr newLayer(const Size& resolution, LayerType type = LayerType::Z, double elevation = 0.0, const Vec2& position = Vec2::Zero());
+
+	// CPU 側で画素を書き換えるレイヤーを作る
+	QuarterLayerPtr newImageLayer(const Image& image, LayerType type = LayerType::Z, double elevation = 0.0, const Vec2& position = Vec2::Zero());
 
-	void erase(QuarterLayerPtr eraseLayer)
+	// 同じ解像度のレイヤーをまとめて確保する
+	// initializer には生成順の添字と生成したレイヤーが渡される
+	Array<QuarterLayerPtr> newLayers(size_t count, const Size& resolution, LayerType type = LayerType::Z, std::function<void(size_t, QuarterLayer&)> initializer = nullptr);
+
+	void reserve(size_t layerCount);
+
+	// 【注意】レイヤーの実体は詰めて並べているので、erase() すると末尾のレイヤーが消したレイヤーの位置に移動する
+	// *pLayer で取り出した QuarterLayer& や QuarterLayer* を保持していると、エラーにならずに別のレイヤーを指すようになる
+	// レイヤーは QuarterLayerPtr で保持し、使うときに -> で引き直すこと
+	void erase(QuarterLayerPtr eraseLayer);
+
+	bool isValid(const QuarterLayerPtr& layer)const
 	{
-		layers.erase(std::remove_if(layers.begin(), layers.end(), [&](QuarterLayerPtr p) { return p == eraseLayer; }), layers.end());
+		const QuarterView& source = owner();
+		return layer.pQuarterView == &source && layer.slotIndex < source.layerSlots.size() && source.layerSlots[layer.slotIndex].generation == layer.generation;
 	}
 
+	size_t layerCount()const { return owner().layers.size(); }
+
+	// 指定した drawGroup の範囲のレイヤーを1枚のテクスチャにまとめて描画する
+	// 焼き込まれるのは setRetainContents(true) にしたレイヤー、record() で描くレイヤー、Image レイヤーだけで、
+	// 毎フレーム render() するレイヤーは焼き込まずに個別に描画する
+	// drawPartial() が範囲の一部だけを描画するときは、メンバーのレイヤーが個別に描画される
+	QuarterImpostorPtr newImpostor(int32 beginGroupIndex, size_t drawGroupCount = 1);
+
+	void erase(QuarterImpostorPtr eraseImpostor);
+
 	Vec2 vectorX()const { return Vec2(Math::Cos(angleAxisX), Math::Sin(angleAxisX)); }
 
 	Vec2 vectorY()const { return Vec2(0, -1); }
@@ -126,8 +439,264 @@ public:
 
 	Vec2 origin = Vec2::Zero();
 
+	// origin を中心とした拡大率
+	double zoom = 1.0;
+
+	// 描画先の範囲。none なら画面全体
+	// 設定した場合、origin などの座標はこの範囲の左上を原点とする
+	Optional<Rect> viewport;
+
+	Vec2 viewSize()const { return viewport ? Vec2(viewport->size()) : Vec2(Scene::Size()); }
+
+	Vec2 viewCenter()const { return viewSize() * 0.5; }
+
+	// 1フレームにかける時間の目標 [秒]。averageFrameTime() と比べる
+	// 0 より大きい値を設定すると、超過が続いたときに qualityLevel() を上げて描画の負荷を減らす
+	//   1: 画面上で小さいレイヤー、画面外のレイヤーの解像度を下げる
+	//   2: 加えて render() の間隔を2フレームに1回にする
+	//   3: 加えて render() の間隔を4フレームに1回にし、MSAA の resolve を1フレームおきにする
+	double frameBudget = 0.0;
+
+	static constexpr int32 MaxQualityLevel = 3;
+
+	// 0 が最高品質
+	int32 qualityLevel()const { return quality; }
+
+	// true にすると draw() は合成結果を保持しておき、前のフレームから変化したレイヤーと重なる範囲だけを合成し直す
+	// 再描画・移動したレイヤーが少ない場合に向く。drawPartial() では使われない
+	bool retainedComposition = false;
+
+	// true にすると、画面上の大きさ・フォーカスしたレイヤーからの距離・renderPriority に応じて
+	// レイヤーごとに render() の間隔を 1 ～ maxRenderInterval フレームに伸ばす
+	bool renderScheduling = false;
+
+	uint32 maxRenderInterval = 8;
+
+	// このフレームで render() すべきレイヤー
+	const Array<QuarterLayerPtr>& layersDueForRender()const { return dueLayers; }
+
+	// Scene::DeltaTime() の移動平均 [秒]
+	// System::Update() や QuarterView 以外の処理の時間も含む。frameBudget が 0 のときも更新される
+	double averageFrameTime()const { return averageFrameSec; }
+
+	// レイヤーの render()・移動・増減や背景色の変更のたびに増える
+	uint64 getChangeGeneration()const { return owner().changeGeneration; }
+
+	// 前回の draw() から見た目を変える変更がなければ true
+	// このフレームの render() を済ませた後に呼び、true なら draw() を省略して前のフレームを使い回せる
+	// render() で描くレイヤーは、setRetainContents(true) にしておかないと毎回 render() が要求されるので idle にならない
+	bool isIdle()const;
+
+	// alignPos や type の書き換えなど、自動では検出されない変更を知らせる
+	void markChanged()
+	{
+		++owner().changeGeneration;
+		++owner().markedChangeCount;
+	}
+
 private:
-	std::vector<QuarterLayerPtr> layers;
+
+	friend class QuarterLayerPtr;
+	friend class QuarterLayer;
+
+	// レイヤーの実体は layers に詰めて並べ、ハンドルからはスロットを介して参照する
+	struct LayerSlot
+	{
+		uint32 denseIndex;
+		uint32 generation;
+	};
+
+	QuarterView& owner() { return pLayerSource ? *pLayerSource : *this; }
+
+	const QuarterView& owner()const { return pLayerSource ? *pLayerSource : *this; }
+
+	QuarterLayer* find(const QuarterLayerPtr& layer)
+	{
+		return isValid(layer) ? &owner().layers[owner().layerSlots[layer.slotIndex].denseIndex] : nullptr;
+	}
+
+	QuarterLayerPtr handleAt(size_t denseIndex)
+	{
+		const uint32 slotIndex = denseSlotIndices[denseIndex];
+		return QuarterLayerPtr(this, slotIndex, layerSlots[slotIndex].generation);
+	}
+
+	QuarterLayerPtr allocateSlot();
+
+	// update() や描画順の計算で毎フレーム走査する値は、テクスチャなどを持つレイヤー本体とは別の密な配列に置く
+	// どれも layers と同じ添字で引く
+	struct LayerTransform
+	{
+		Vec2 position = Vec2::Zero();
+		Vec2 scale = Vec2::One();
+	};
+
+	struct LayerState
+	{
+		uint32 revision = 0;
+		uint32 scheduledInterval = 1;
+		uint32 renderInterval = 1;
+		uint32 renderPhase = 0;
+		bool visible = true;
+		bool imageLayer = false;
+		bool hasContents = false;
+		bool rendered = false;
+		bool renderDue = true;
+		bool resolved = true;
+		bool resolveDeferred = false;
+		bool pendingUpload = false;
+		bool moving = false;
+		bool retainContents = false;
+		bool recorded = false;
+	};
+
+	void invalidateImpostors();
+
+	// インポスタに焼き込むレイヤー
+	// 個別に描画される条件 (visible で render() 済み) に加えて、毎フレームの render() で内容が変わらないものに限る
+	static bool IsImpostorMember(const LayerState& state)
+	{
+		return state.visible && (state.rendered || state.imageLayer) && (state.imageLayer || state.retainContents || state.recorded);
+	}
+
+	// 焼き込まれているレイヤーに、焼き込んだインポスタを対応させる。layers と同じ添字で引く
+	std::vector<const QuarterImpostor*> collectBakedImpostors()const;
+
+	bool needsBake(const QuarterImpostor& impostor)const;
+
+	void bake(QuarterImpostor& impostor);
+
+	void bakeImpostors();
+
+	struct DrawItem
+	{
+		int32 drawGroup;
+		double order;
+		const QuarterLayer* pLayer;
+		const QuarterImpostor* pImpostor;
+		const QuarterImpostor* pBakedInto;
+	};
+
+	// 描画する drawGroup の範囲がインポスタの範囲をすべて含むときだけインポスタを使い、
+	// 一部しか含まないときはメンバーのレイヤーを個別に描画する
+	static bool CoversImpostor(int32 beginGroupIndex, size_t drawGroupCount, const QuarterImpostor& impostor);
+
+	static bool IsDrawnInRange(const DrawItem& item, int32 beginGroupIndex, size_t drawGroupCount);
+
+	Array<DrawItem> collectDrawItems()const;
+
+	const Array<DrawItem>& currentDrawPlan();
+
+	bool isResolveSkipped(size_t denseIndex)const;
+
+	void resolveItems(const DrawItem* first, const DrawItem* last, int32 beginGroupIndex, size_t drawGroupCount);
+
+	void drawItem(const DrawItem& item)const;
+
+	// drawGroup 順に並んだ描画順と、それを作ったときのフレームとレイヤーの増減・drawGroup の変更の回数
+	// フレームは共有元の update() で進むので、共有している視点も同じフレームに作り直す
+	// visible と render() 済みかどうかは描画するときに判定するので、描画順を作った後に render() されたレイヤーも描画される
+	Array<DrawItem> drawPlan;
+	bool hasDrawPlan = false;
+	uint64 drawPlanFrame = 0;
+	uint64 drawPlanOrderRevision = 0;
+	uint64 drawOrderRevision = 0;
+
+	// 共有元で集計する変更の回数と、各視点が前回 draw() したときの状態
+	mutable uint64 changeGeneration = 0;
+	// markChanged() の回数。レイヤーの revision に現れない変更があったら画面上の範囲を求め直す
+	uint64 markedChangeCount = 0;
+	bool skippedResolve = false;
+	// update() で数え、render() のたびに減らす
+	size_t unrenderedDueLayerCount = 0;
+	bool hasDrawn = false;
+	uint64 drawnChangeGeneration = 0;
+	Vec2 drawnOrigin = Vec2::Zero();
+	double drawnAngleAxisX = 0.0;
+	double drawnAngleAxisZ = 0.0;
+	double drawnZoom = 1.0;
+	Size drawnViewSize = Size(0, 0);
+
+	void recordDrawnState();
+
+	static constexpr size_t MaxDamageRegions = 16;
+
+	void addDamage(const RectF& rect);
+
+	// 各視点が前回合成したときのレイヤーの状態。スロットの添字で引く
+	struct ComposedState
+	{
+		uint32 generation = 0;
+		bool composed = false;
+		RectF bounds;
+		uint32 revision = 0;
+		int32 drawGroup = 0;
+	};
+
+	Array<RectF> collectDamage(const Array<DrawItem>& items);
+
+	Array<Rect> mergeDamage();
+
+	// 前回合成したときから、変更・視点の移動・遅れた resolve・描かれなかったレイヤーがなければ true
+	bool isCompositeCurrent()const;
+
+	void updateComposite();
+
+	void drawRetained();
+
+	RenderTexture composite;
+	Array<Rect> damagedRects;
+	Vec2 composedOrigin = Vec2::Zero();
+	double composedAngleAxisX = 0.0;
+	double composedAngleAxisZ = 0.0;
+	double composedZoom = 1.0;
+	bool hasComposite = false;
+	uint64 composedChangeGeneration = 0;
+	uint64 composedMarkedChangeCount = 0;
+	std::vector<ComposedState> composedStates;
+
+	QuarterView* pLayerSource = nullptr;
+	// レイヤーを共有している視点。レイヤーの解像度はすべての視点での大きさから決める
+	std::vector<QuarterView*> sharingViews;
+
+	std::vector<QuarterLayer> layers;
+	std::vector<LayerTransform> layerTransforms;
+	std::vector<double> layerElevations;
+	std::vector<int32> layerDrawGroups;
+	std::vector<LayerState> layerStates;
+	std::vector<uint32> denseSlotIndices;
+	std::vector<LayerSlot> layerSlots;
+	std::vector<uint32> freeSlotIndices;
+
+	std::vector<QuarterImpostorPtr> impostors;
+
+	void updateQuality();
+
+	void updateBackingScales();
+
+	uint32 qualityRenderInterval()const
+	{
+		const uint32 intervals[] = { 1, 1, 2, 4 };
+		return intervals[quality];
+	}
+
+	void updateRenderSchedule();
+
+	void setRenderInterval(LayerState& state, uint32 interval);
+
+	const QuarterLayer* focusedLayer()const;
+
+	void setFocusedLayer(const QuarterLayer& layer);
+
+	QuarterLayerPtr focusedLayerHandle;
+	Array<QuarterLayerPtr> dueLayers;
+	std::array<uint32, 32> renderPhaseCounters = {};
+
+	double averageFrameSec = 0.0;
+	int32 quality = 0;
+	int32 overBudgetFrames = 0;
+	int32 underBudgetFrames = 0;
+	uint64 frameCount = 0;
 };
 
 template<class TransformerObj>
@@ -157,74 +726,348 @@ private:
 	Rect region;
 };
 
-class QuarterLayer
+// レイヤーへの2D描画命令を記録したもの
+// 同じ内容かどうかを比較でき、アプリケーションのコードを呼ばずに描き直せる
+class QuarterDrawCommands
 {
 public:
 
-	QuarterLayer(const QuarterView& quarterView, LayerType type, const Size& size, const Vec2& position, double elevation, const Vec2& scale) :
-		quarterViewRef(quarterView),
-		type(type),
-		texture(size),
-		scale(scale)
+	void rect(const RectF& rect, const ColorF& color)
 	{
-		setBackground(backGroundColor);
+		push(Type::Rect, color, { rect.x, rect.y, rect.w, rect.h });
+	}
 
-		const LayerAlignPos defaultAlignments[] = { LayerAlignPos::BottomLeft, LayerAlignPos::BottomRight, LayerAlignPos::TopLeft };
-		alignPos = defaultAlignments[static_cast<int32>(type)];
+	void rectFrame(const RectF& rect, double thickness, const ColorF& color)
+	{
+		push(Type::RectFrame, color, { rect.x, rect.y, rect.w, rect.h, thickness });
+	}
 
-		setPosition(position);
-		setElevation(elevation);
+	void circle(const Vec2& center, double r, const ColorF& color)
+	{
+		push(Type::Circle, color, { center.x, center.y, r });
 	}
 
-	LayerRegion<std::tuple<ScopedRenderTarget2D, ScopedRenderStates2D, Transformer2D>> render(bool clearColor = true, bool transformCursor = true)
+	void line(const Vec2& begin, const Vec2& end, double thickness, const ColorF& color)
 	{
-		rendered = true;
-		if (clearColor)
-		{
-			texture.clear(backGroundColor);
-		}
-		resolved = false;
+		push(Type::Line, color, { begin.x, begin.y, end.x, end.y, thickness });
+	}
+
+	void triangle(const Vec2& p0, const Vec2& p1, const Vec2& p2, const ColorF& color)
+	{
+		push(Type::Triangle, color, { p0.x, p0.y, p1.x, p1.y, p2.x, p2.y });
+	}
+
+	void quad(const Quad& quad, const ColorF& color)
+	{
+		push(Type::Quad, color, { quad.p0.x, quad.p0.y, quad.p1.x, quad.p1.y, quad.p2.x, quad.p2.y, quad.p3.x, quad.p3.y });
+	}
+
+	void polygon(const Polygon& polygon, const ColorF& color)
+	{
+		push(Type::Polygon, color, {}, static_cast<uint32>(polygons.size()));
+		polygons.push_back(polygon);
+	}
+
+	void texture(const Texture& texture, const Vec2& pos, const ColorF& color = Palette::White)
+	{
+		push(Type::Texture, color, { pos.x, pos.y }, static_cast<uint32>(textures.size()));
+		textures.push_back(texture);
+	}
+
+	void clear()
+	{
+		commands.clear();
+		polygons.clear();
+		textures.clear();
+	}
+
+	bool isEmpty()const { return commands.empty(); }
+
+	size_t size()const { return commands.size(); }
+
+	void execute()const
+	{
+		for (const auto& command : commands)
+		{
+			const auto& p = command.params;
+			switch (command.type)
+			{
+			case Type::Rect:
+				RectF(p[0], p[1], p[2], p[3]).draw(command.color);
+				break;
+			case Type::RectFrame:
+				RectF(p[0], p[1], p[2], p[3]).drawFrame(p[4], command.color);
+				break;
+			case Type::Circle:
+				Circle(p[0], p[1], p[2]).draw(command.color);
+				break;
+			case Type::Line:
+				Line(p[0], p[1], p[2], p[3]).draw(p[4], command.color);
+				break;
+			case Type::Triangle:
+				Triangle(Vec2(p[0], p[1]), Vec2(p[2], p[3]), Vec2(p[4], p[5])).draw(command.color);
+				break;
+			case Type::Quad:
+				Quad(Vec2(p[0], p[1]), Vec2(p[2], p[3]), Vec2(p[4], p[5]), Vec2(p[6], p[7])).draw(command.color);
+				break;
+			case Type::Polygon:
+				polygons[command.resourceIndex].draw(command.color);
+				break;
+			case Type::Texture:
+				textures[command.resourceIndex].draw(p[0], p[1], command.color);
+				break;
+			default:
+				break;
+			}
+		}
+	}
+
+	bool operator==(const QuarterDrawCommands& other)const
+	{
+		if (commands.size() != other.commands.size() || polygons.size() != other.polygons.size() || textures.size() != other.textures.size())
+		{
+			return false;
+		}
+
+		for (size_t i = 0; i < commands.size(); ++i)
+		{
+			const Command& a = commands[i];
+			const Command& b = other.commands[i];
+			if (a.type != b.type || a.resourceIndex != b.resourceIndex || a.color != b.color || a.params != b.params)
+			{
+				return false;
+			}
+		}
+
+		for (size_t i = 0; i < polygons.size(); ++i)
+		{
+			if (polygons[i].outer() != other.polygons[i].outer() || polygons[i].inners() != other.polygons[i].inners())
+			{
+				return false;
+			}
+		}
+
+		for (size_t i = 0; i < textures.size(); ++i)
+		{
+			if (textures[i].id() != other.textures[i].id())
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool operator!=(const QuarterDrawCommands& other)const
+	{
+		return !(*this == other);
+	}
+
+private:
+
+	enum class Type : uint8 { Rect, RectFrame, Circle, Line, Triangle, Quad, Polygon, Texture };
+
+	struct Command
+	{
+		Type type;
+		ColorF color;
+		uint32 resourceIndex;
+		std::array<double, 8> params;
+	};
+
+	void push(Type type, const ColorF& color, std::initializer_list<double> params, uint32 resourceIndex = 0)
+	{
+		Command command{ type, color, resourceIndex, {} };
+		std::copy(params.begin(), params.end(), command.params.begin());
+		commands.push_back(command);
+	}
+
+	std::vector<Command> commands;
+	Array<Polygon> polygons;
+	Array<Texture> textures;
+};
+
+// render() の代わりに使うと、描画命令を記録してスコープの終わりにレイヤーへ描画する
+// 前回記録した内容と同じであれば描き直さない
+class QuarterLayerRecorder : public QuarterDrawCommands
+{
+public:
+
+	QuarterLayerRecorder(const QuarterLayerPtr& layer, const Size& layerSize, const Mat3x2& cursorMat);
+
+	QuarterLayerRecorder(const QuarterLayerRecorder&) = delete;
+
+	QuarterLayerRecorder& operator=(const QuarterLayerRecorder&) = delete;
+
+	~QuarterLayerRecorder();
+
+	const Rect& region()const { return layerRegion; }
+
+private:
+
+	// スコープ内で newLayer() や erase() が呼ばれてレイヤーの実体が移動しても、終わりに引き直せるようにハンドルで持つ
+	QuarterLayerPtr layer;
+	Rect layerRegion;
+	Transformer2D cursorTransformer;
+};
+
+class QuarterLayer
+{
+public:
+
+	QuarterLayer(QuarterView& quarterView, uint32 slotIndex, LayerType type, const Size& size, const Vec2& position, double elevation, const Vec2& scale) :
+		type(type),
+		texture(size),
+		quarterViewRef(quarterView),
+		slotIndex(slotIndex),
+		resolution(size),
+		scale(scale)
+	{
+		setBackground(backGroundColor);
+
+		const LayerAlignPos defaultAlignments[] = { LayerAlignPos::BottomLeft, LayerAlignPos::BottomRight, LayerAlignPos::TopLeft };
+		alignPos = defaultAlignments[static_cast<int32>(type)];
+
+		setPosition(position);
+		setElevation(elevation);
+	}
+
+	// CPU 側の Image を内容とするレイヤー
+	// render() の代わりに getImage() を書き換えて markDirty() で更新範囲を通知する
+	QuarterLayer(QuarterView& quarterView, uint32 slotIndex, LayerType type, const Image& image, const Vec2& position, double elevation, const Vec2& scale) :
+		type(type),
+		quarterViewRef(quarterView),
+		slotIndex(slotIndex),
+		resolution(image.size()),
+		image(image),
+		imageTexture(image),
+		scale(scale)
+	{
+		state().imageLayer = true;
+		state().hasContents = true;
+
+		const LayerAlignPos defaultAlignments[] = { LayerAlignPos::BottomLeft, LayerAlignPos::BottomRight, LayerAlignPos::TopLeft };
+		alignPos = defaultAlignments[static_cast<int32>(type)];
+
+		setPosition(position);
+		setElevation(elevation);
+	}
+
+	LayerRegion<std::tuple<ScopedRenderTarget2D, ScopedRenderStates2D, Transformer2D>> render(bool clearColor = true, bool transformCursor = true)
+	{
+		if (isImageLayer())
+		{
+			throw Error(U"QuarterLayer::render(): image layers are updated through getImage() and markDirty()");
+		}
+
+		markRendered();
+		state().hasContents = true;
+		state().recorded = false;
+		recordedCommands.clear();
+		touch();
+		if (clearColor)
+		{
+			texture.clear(backGroundColor);
+		}
+		state().resolved = false;
 
 		const auto mat = getMat();
 		return LayerRegion<std::tuple<ScopedRenderTarget2D, ScopedRenderStates2D, Transformer2D>>(
-			Rect(texture.size()),
+			Rect(resolution),
 			std::tuple<ScopedRenderTarget2D, ScopedRenderStates2D, Transformer2D>(
 				ScopedRenderTarget2D(texture),
 				BlendState(true, Blend::SrcAlpha, Blend::InvSrcAlpha, BlendOp::Add, Blend::One, Blend::InvSrcAlpha),
-				Transformer2D(Mat3x2::Identity(), transformCursor ? mat : Mat3x2::Identity())
+				Transformer2D(Mat3x2::Scale(backingScale), transformCursor ? mat : Mat3x2::Identity())
 				)
 			);
 	}
 
+	// 描画命令を記録して描画する
+	// 記録した命令は背景色や解像度の変更時に QuarterView が描き直すのに使われる
+	QuarterLayerRecorder record(bool transformCursor = true);
+
+	const QuarterDrawCommands& getRecordedCommands()const { return recordedCommands; }
+
 	LayerRegion<Transformer2D> renderDirectly(bool transformCursor = true)const
 	{
 		const auto mat = getMat();
 		return LayerRegion<Transformer2D>(
-			Rect(texture.size()),
+			Rect(resolution),
 			Transformer2D(mat, transformCursor ? mat : Mat3x2::Identity())
 			);
 	}
 
-	int32 width()const { return texture.width(); }
+	int32 width()const { return resolution.x; }
 
-	int32 height()const { return texture.height(); }
+	int32 height()const { return resolution.y; }
 
-	Size size()const { return texture.size(); }
+	Size size()const { return resolution; }
 
 	void setBackground(Color color)
 	{
 		backGroundColor = color;
-		resolved = false;
+		if (isImageLayer())
+		{
+			return;
+		}
+		state().resolved = false;
+		touch();
 		texture.clear(backGroundColor);
+		replay();
+	}
+
+	bool isResolved()const { return state().resolved; }
+
+	// Image レイヤーは内容を保持し続けるので常に描画対象になる
+	bool isRendered()const { return state().rendered || state().imageLayer; }
+
+	bool isImageLayer()const { return state().imageLayer; }
+
+	// 負荷に応じて QuarterView が下げる、解像度に対する描画先テクスチャの倍率
+	double getBackingScale()const { return backingScale; }
+
+	// false のフレームでは render() を省略しても前回の内容で描画される
+	bool isRenderDue()const { return state().renderDue; }
+
+	// 何フレームに1回 render() が必要になるか
+	uint32 getRenderInterval()const { return state().renderInterval; }
+
+	Image& getImage() { return image; }
+
+	const Image& getImage()const { return image; }
+
+	// 書き換えた範囲を通知すると、次の draw() でその範囲だけがテクスチャに転送される
+	void markDirty(const Rect& region)
+	{
+		const int32 left = Max(region.x, 0);
+		const int32 top = Max(region.y, 0);
+		const int32 right = Min(region.x + region.w, resolution.x);
+		const int32 bottom = Min(region.y + region.h, resolution.y);
+		if (right <= left || bottom <= top)
+		{
+			return;
+		}
+		dirtyRects.emplace_back(left, top, right - left, bottom - top);
+		state().pendingUpload = true;
+		touch();
 	}
 
-	bool isResolved()const { return resolved; }
+	void markDirty()
+	{
+		markDirty(Rect(resolution));
+	}
 
-	bool isRendered()const { return rendered; }
+	// render() や移動によって見た目が変わるたびに増える
+	uint32 getRevision()const { return state().revision; }
 
 	Mat3x2 getMat()const
 	{
-		const auto& quarterView = quarterViewRef.get();
+		return getMat(quarterViewRef.get());
+	}
+
+	// quarterView の視点から見たときの変換
+	Mat3x2 getMat(const QuarterView& quarterView)const
+	{
 		const double angleAxisX = quarterView.angleAxisX;
 		const double angleAxisZ = quarterView.angleAxisZ;
 		const Vec2& screenOrigin = quarterView.origin;
@@ -237,20 +1080,22 @@ public:
 		case LayerType::Z:
 			return
 				//原点をテクスチャ左下に合わせる
-				BaseTranslate(alignPos, texture.size())
-				.scaled(scale.getValue())
+				BaseTranslate(alignPos, resolution)
+				.scaled(getScale())
 				.translated(getPosition())
 				//shearedYで引き延ばされるscaleの補正
 				.scaled(Math::Cos(angleAxisX), 1.0)
 				//角度をずらす
 				.shearedY(Math::Tan(angleAxisX))
 				//elevation
-				.translated(Vec2(-Math::Cos(angleAxisZ), Math::Sin(angleAxisZ)) * getElevation() + screenOrigin);
+				.translated(Vec2(-Math::Cos(angleAxisZ), Math::Sin(angleAxisZ)) * getElevation())
+				.scaled(quarterView.zoom)
+				.translated(screenOrigin);
 		case LayerType::X:
 			return
 				//原点をテクスチャ右下に合わせる
-				BaseTranslate(alignPos, texture.size())
-				.scaled(scale.getValue())
+				BaseTranslate(alignPos, resolution)
+				.scaled(getScale())
 				.translated(getPosition())
 				//shearedYで引き延ばされるscaleの補正
 				.scaled(Math::Cos(angleAxisZ), 1.0)
@@ -259,16 +1104,20 @@ public:
 				//角度をずらす
 				.shearedY(Math::Tan(-angleAxisZ))
 				//elevation
-				.translated(Vec2(Math::Cos(angleAxisX), Math::Sin(angleAxisX)) * getElevation() + screenOrigin);
+				.translated(Vec2(Math::Cos(angleAxisX), Math::Sin(angleAxisX)) * getElevation())
+				.scaled(quarterView.zoom)
+				.translated(screenOrigin);
 		case LayerType::Y:
 		{
 			return
-				BaseTranslate(alignPos, texture.size())
-				.scaled(scale.getValue())
+				BaseTranslate(alignPos, resolution)
+				.scaled(getScale())
 				.translated(getPosition())
 				.rotated(theta)
 				.scaled(Vec2(1, s) * s2)
-				.translated(Vec2(0, -getElevation()) + screenOrigin);
+				.translated(Vec2(0, -getElevation()))
+				.scaled(quarterView.zoom)
+				.translated(screenOrigin);
 		}
 		default: return Mat3x2::Identity();
 		}
@@ -321,44 +1170,56 @@ public:
 		}
 	}
 
-	Vec2 getPosition()const { return Vec2(get2DPositionX(), get2DPositionY()); }
+	Vec2 getPosition()const { return transform().position; }
 	void setPosition(const Vec2& newPosition, bool force = true)
 	{
 		set2DPositionX(newPosition.x, force);
 		set2DPositionY(newPosition.y, force);
+		syncTransform();
+		touch();
 	}
 	void setTargetPosition(const Vec2& newPosition, int32 transitionMilliSec = 200, std::function<double(double)> transitionFunc = EaseOutCirc)
 	{
 		setTarget2DPositionX(newPosition.x, transitionMilliSec, transitionFunc);
 		setTarget2DPositionY(newPosition.y, transitionMilliSec, transitionFunc);
+		syncTransform();
+		touch();
 	}
 	bool isPositionMoving()const { return is2DPositionMoving(); }
 	
 	double getElevation()const
 	{
-		return elevationValue().getValue();
+		return quarterViewRef.get().layerElevations[denseIndex()];
 	}
 	void setElevation(double newElevation, bool force = true)
 	{
 		elevationValue().setValue(newElevation, force);
+		syncTransform();
+		touch();
 	}
 	void setTargetElevation(double newElevation, int32 transitionMilliSec = 200, std::function<double(double)> transitionFunc = EaseOutCirc)
 	{
 		elevationValue().setTargetValue(newElevation, transitionMilliSec, transitionFunc);
+		syncTransform();
+		touch();
 	}
 	bool isElevationMoving()const
 	{
 		return elevationValue().isMoving();
 	}
 	
-	const Vec2& getScale()const { return scale.getValue(); }
+	const Vec2& getScale()const { return transform().scale; }
 	void setScale(const Vec2& newScale, bool force = true)
 	{
 		scale.setValue(newScale, force);
+		syncTransform();
+		touch();
 	}
 	void setTargetScale(const Vec2& newScale, int32 transitionMilliSec = 200, std::function<double(double)> transitionFunc = EaseOutCirc)
 	{
 		scale.setTargetValue(newScale, transitionMilliSec, transitionFunc);
+		syncTransform();
+		touch();
 	}
 	bool isScaleMoving()const { return scale.isMoving(); }
 
@@ -371,31 +1232,88 @@ public:
 		_x.setValue(newPosition.x);
 		_y.setValue(newPosition.y);
 		_z.setValue(newPosition.z);
+		syncTransform();
+		touch();
 	}
 	void setTarget3DPosition(const Vec3& newPosition, int32 transitionMilliSec = 200, std::function<double(double)> transitionFunc = EaseOutCirc)
 	{
 		_x.setTargetValue(newPosition.x, transitionMilliSec, transitionFunc);
 		_y.setTargetValue(newPosition.y, transitionMilliSec, transitionFunc);
 		_z.setTargetValue(newPosition.z, transitionMilliSec, transitionFunc);
+		syncTransform();
+		touch();
 	}
 	bool is3DPositionMoving()const { return _x.isMoving() || _y.isMoving() || _z.isMoving(); }
 
+	// 【非互換】以前の public メンバー drawGroup は廃止した。layer->drawGroup = n は setDrawGroup(n) に置き換えること
+	// drawGroup は QuarterView 側の配列に置かれ、変更すると描画順が作り直される
+	int32 getDrawGroup()const { return quarterViewRef.get().layerDrawGroups[denseIndex()]; }
+	void setDrawGroup(int32 newDrawGroup)
+	{
+		int32& drawGroup = quarterViewRef.get().layerDrawGroups[denseIndex()];
+		if (drawGroup != newDrawGroup)
+		{
+			drawGroup = newDrawGroup;
+			++quarterViewRef.get().drawOrderRevision;
+			touch();
+		}
+	}
+
+	// true にすると render() を呼ばないフレームでも前回の内容を描画し続け、render() が要求されるのは内容を失ったときだけになる
+	// 内容を変えたいときにだけ render() すればよいので、静止した画面では QuarterView::isIdle() が true になる
+	bool isRetainingContents()const { return state().retainContents; }
+	void setRetainContents(bool retain) { state().retainContents = retain; }
+
+	// false の間は draw() で描画されない
+	bool isVisible()const { return state().visible; }
+	void setVisible(bool newVisible)
+	{
+		if (state().visible != newVisible)
+		{
+			state().visible = newVisible;
+			touch();
+		}
+	}
+
 	LayerType type;
 	LayerAlignPos alignPos;
-	int32 drawGroup = 0;
+
+	// renderScheduling が有効なとき、大きいほど頻繁に再描画される
+	double renderPriority = 1.0;
 	
 	MSRenderTexture texture;
 
 private:
 
-	void update()
+	size_t denseIndex()const { return quarterViewRef.get().layerSlots[slotIndex].denseIndex; }
+
+	QuarterView::LayerState& state() { return quarterViewRef.get().layerStates[denseIndex()]; }
+
+	const QuarterView::LayerState& state()const { return quarterViewRef.get().layerStates[denseIndex()]; }
+
+	const QuarterView::LayerTransform& transform()const { return quarterViewRef.get().layerTransforms[denseIndex()]; }
+
+	// 遷移中の値を QuarterView の密な配列に書き戻す
+	void syncTransform()
+	{
+		QuarterView& quarterView = quarterViewRef.get();
+		const size_t i = denseIndex();
+		quarterView.layerTransforms[i].position = Vec2(get2DPositionX(), get2DPositionY());
+		quarterView.layerTransforms[i].scale = scale.getValue();
+		quarterView.layerElevations[i] = elevationValue().getValue();
+		quarterView.layerStates[i].moving = is3DPositionMoving() || scale.isMoving();
+	}
+
+	// 移動中のレイヤーについてだけ QuarterView::update() から呼ばれる
+	void updateTransition()
 	{
-		rendered = false;
+		touch();
 
 		_x.update();
 		_y.update();
 		_z.update();
 		scale.update();
+		syncTransform();
 	}
 
 	bool is2DPositionMoving()const
@@ -500,161 +1418,1358 @@ private:
 		}
 	}
 
-	Transitional<double>& elevationValue()
+	Transitional<double>& elevationValue()
+	{
+		switch (type)
+		{
+		case LayerType::Z:
+			return _z;
+		case LayerType::X:
+			return _x;
+		default:
+			return _y;
+		}
+	}
+
+	const Transitional<double>& elevationValue()const
+	{
+		switch (type)
+		{
+		case LayerType::Z:
+			return _z;
+		case LayerType::X:
+			return _x;
+		default:
+			return _y;
+		}
+	}
+
+	void markRendered()
+	{
+		QuarterView::LayerState& layerState = state();
+		if (layerState.renderDue && !layerState.rendered && !layerState.imageLayer)
+		{
+			--quarterViewRef.get().unrenderedDueLayerCount;
+		}
+		layerState.rendered = true;
+	}
+
+	void touch()
+	{
+		++state().revision;
+		++quarterViewRef.get().changeGeneration;
+	}
+
+	void resolve()
+	{
+		if (!state().resolved)
+		{
+			texture.resolve();
+			state().resolved = true;
+
+			//遅らせた resolve の前にインポスタや合成結果が古い内容を取り込んでいるので、変化として扱う
+			if (state().resolveDeferred)
+			{
+				state().resolveDeferred = false;
+				touch();
+			}
+		}
+	}
+
+	void upload()
+	{
+		state().pendingUpload = false;
+		if (dirtyRects.empty())
+		{
+			return;
+		}
+
+		//重なる更新範囲はまとめてから転送する
+		std::sort(dirtyRects.begin(), dirtyRects.end(), [](const Rect& a, const Rect& b) { return a.y < b.y; });
+		Array<Rect> regions;
+		for (const auto& rect : dirtyRects)
+		{
+			if (!regions.isEmpty() && regions.back().intersects(rect))
+			{
+				Rect& region = regions.back();
+				const int32 right = Max(region.x + region.w, rect.x + rect.w);
+				const int32 bottom = Max(region.y + region.h, rect.y + rect.h);
+				region.x = Min(region.x, rect.x);
+				region.y = Min(region.y, rect.y);
+				region.w = right - region.x;
+				region.h = bottom - region.y;
+			}
+			else
+			{
+				regions.push_back(rect);
+			}
+		}
+		dirtyRects.clear();
+
+		for (const auto& region : regions)
+		{
+			imageTexture.fillRegion(image, region);
+		}
+	}
+
+	void drawContents()const
+	{
+		if (isImageLayer())
+		{
+			imageTexture.draw();
+		}
+		else if (backingScale != 1.0)
+		{
+			texture.scaled(1.0 / backingScale).draw();
+		}
+		else
+		{
+			texture.draw();
+		}
+	}
+
+	void setBackingScale(double newScale)
+	{
+		if (isImageLayer() || backingScale == newScale)
+		{
+			return;
+		}
+
+		backingScale = newScale;
+		texture = MSRenderTexture(Size(Max(1, static_cast<int32>(Math::Ceil(resolution.x * backingScale))), Max(1, static_cast<int32>(Math::Ceil(resolution.y * backingScale)))));
+		texture.clear(backGroundColor);
+		state().resolved = false;
+		touch();
+
+		//記録した命令があれば描き直し、なければ次の render() まで描画しない
+		//内容を失ったレイヤーは、この後の QuarterView::update() の判定で間隔によらずすぐに描き直させる
+		if (!recordedCommands.isEmpty())
+		{
+			replay();
+			return;
+		}
+		state().rendered = false;
+		state().hasContents = false;
+	}
+
+	void commitRecording(QuarterDrawCommands&& commands)
+	{
+		markRendered();
+		state().recorded = true;
+		if (state().hasContents && !recordedCommands.isEmpty() && commands == recordedCommands)
+		{
+			return;
+		}
+
+		state().hasContents = true;
+		recordedCommands = std::move(commands);
+		touch();
+		texture.clear(backGroundColor);
+		replay();
+	}
+
+	void replay()
+	{
+		if (recordedCommands.isEmpty())
+		{
+			return;
+		}
+
+		{
+			ScopedRenderTarget2D target(texture);
+			ScopedRenderStates2D blend(BlendState(true, Blend::SrcAlpha, Blend::InvSrcAlpha, BlendOp::Add, Blend::One, Blend::InvSrcAlpha));
+			Transformer2D t(Mat3x2::Scale(backingScale));
+			recordedCommands.execute();
+		}
+		state().resolved = false;
+	}
+
+	friend class QuarterView;
+	friend class QuarterLayerRecorder;
+
+	std::reference_wrapper<QuarterView> quarterViewRef;
+	uint32 slotIndex;
+
+	Size resolution;
+
+	QuarterDrawCommands recordedCommands;
+
+	Image image;
+	DynamicTexture imageTexture;
+	Array<Rect> dirtyRects;
+
+	Color backGroundColor = Alpha(0);
+	double backingScale = 1.0;
+
+	Transitional<double> _x, _y, _z;
+	Transitional<Vec2> scale;
+};
+
+inline QuarterLayerRecorder::QuarterLayerRecorder(const QuarterLayerPtr& layer, const Size& layerSize, const Mat3x2& cursorMat) :
+	layer(layer),
+	layerRegion(layerSize),
+	cursorTransformer(Mat3x2::Identity(), cursorMat)
+{}
+
+inline QuarterLayerRecorder::~QuarterLayerRecorder()
+{
+	//スコープ内で erase() されたレイヤーには何もしない
+	if (QuarterLayer* pLayer = layer.get())
+	{
+		pLayer->commitRecording(std::move(static_cast<QuarterDrawCommands&>(*this)));
+	}
+}
+
+inline QuarterLayerRecorder QuarterLayer::record(bool transformCursor)
+{
+	if (isImageLayer())
+	{
+		throw Error(U"QuarterLayer::record(): image layers are updated through getImage() and markDirty()");
+	}
+	QuarterView& quarterView = quarterViewRef.get();
+	return QuarterLayerRecorder(quarterView.handleAt(denseIndex()), resolution, transformCursor ? getMat() : Mat3x2::Identity());
+}
+
+// 静的なレイヤー群をまとめて焼き込んだテクスチャ
+// メンバーの再描画・移動、視点角度の変更があったときだけ焼き直される
+class QuarterImpostor
+{
+public:
+
+	// メンバーは resolve 済みなので、MSAA なしのテクスチャに重ねる
+	static constexpr int32 MaxTextureSize = 4096;
+
+	QuarterImpostor(int32 beginGroupIndex, size_t drawGroupCount) :
+		beginGroup(beginGroupIndex),
+		groupCount(drawGroupCount)
+	{}
+
+	bool contains(int32 groupIndex)const
+	{
+		return beginGroup <= groupIndex && (groupCount == static_cast<size_t>(-1) || groupIndex < beginGroup + static_cast<int32>(groupCount));
+	}
+
+	int32 beginGroupIndex()const { return beginGroup; }
+
+	size_t drawGroupCount()const { return groupCount; }
+
+	bool isBaked()const { return baked; }
+
+	// alignPos や type を直接書き換えた場合などに呼んで焼き直させる
+	void invalidate() { dirty = true; }
+
+private:
+
+	friend class QuarterView;
+
+	int32 beginGroup;
+	size_t groupCount;
+
+	RenderTexture texture;
+	Vec2 offset = Vec2::Zero();
+
+	double angleAxisX = 0.0;
+	double angleAxisZ = 0.0;
+	double zoom = 1.0;
+	std::vector<std::pair<QuarterLayerPtr, uint32>> members;
+
+	bool dirty = true;
+	bool baked = false;
+	uint32 bakeCount = 0;
+
+	bool composed = false;
+	RectF composedBounds;
+	uint32 composedBakeCount = 0;
+};
+
+inline void QuarterTimeline::Set(QuarterLayer& layer, const Optional<Vec2>& position, const Optional<double>& elevation, const Optional<Vec2>& scale)
+{
+	if (position && (layer.getPosition() != *position || layer.isPositionMoving()))
+	{
+		layer.setPosition(*position);
+	}
+	if (elevation && (layer.getElevation() != *elevation || layer.isElevationMoving()))
+	{
+		layer.setElevation(*elevation);
+	}
+	if (scale && (layer.getScale() != *scale || layer.isScaleMoving()))
+	{
+		layer.setScale(*scale);
+	}
+}
+
+inline void QuarterTimeline::apply(QuarterLayer& layer, double time)const
+{
+	const double t = localTime(time);
+	Set(layer,
+		positionTrack.isEmpty() ? none : Optional<Vec2>(positionTrack.sample(t)),
+		elevationTrack.isEmpty() ? none : Optional<double>(elevationTrack.sample(t)),
+		scaleTrack.isEmpty() ? none : Optional<Vec2>(scaleTrack.sample(t)));
+}
+
+inline void QuarterTimeline::apply(const Array<QuarterLayerPtr>& layers, double time, double stagger)const
+{
+	if (stagger != 0.0)
+	{
+		for (size_t i = 0; i < layers.size(); ++i)
+		{
+			apply(*layers[i], time + i * stagger);
+		}
+		return;
+	}
+
+	//全レイヤーが同じ時刻なら一度だけ評価する
+	const double t = localTime(time);
+	const Optional<Vec2> position = positionTrack.isEmpty() ? none : Optional<Vec2>(positionTrack.sample(t));
+	const Optional<double> elevation = elevationTrack.isEmpty() ? none : Optional<double>(elevationTrack.sample(t));
+	const Optional<Vec2> scale = scaleTrack.isEmpty() ? none : Optional<Vec2>(scaleTrack.sample(t));
+	for (const auto& pLayer : layers)
+	{
+		Set(*pLayer, position, elevation, scale);
+	}
+}
+
+inline bool QuarterLayerPtr::isValid()const
+{
+	return pQuarterView && pQuarterView->isValid(*this);
+}
+
+inline QuarterLayer* QuarterLayerPtr::get()const
+{
+	return pQuarterView ? pQuarterView->find(*this) : nullptr;
+}
+
+inline QuarterLayer* QuarterLayerPtr::operator->()const
+{
+	QuarterLayer* pLayer = get();
+	if (!pLayer)
+	{
+		throw Error(U"QuarterLayerPtr: the layer has been erased");
+	}
+	return pLayer;
+}
+
+inline QuarterLayer& QuarterLayerPtr::operator*()const
+{
+	return *operator->();
+}
+
+inline QuarterLayerPtr QuarterView::allocateSlot()
+{
+	const uint32 denseIndex = static_cast<uint32>(layers.size());
+	if (freeSlotIndices.empty())
+	{
+		layerSlots.push_back(LayerSlot{ denseIndex, 0 });
+		denseSlotIndices.push_back(static_cast<uint32>(layerSlots.size() - 1));
+	}
+	else
+	{
+		const uint32 slotIndex = freeSlotIndices.back();
+		freeSlotIndices.pop_back();
+		layerSlots[slotIndex].denseIndex = denseIndex;
+		denseSlotIndices.push_back(slotIndex);
+	}
+	layerTransforms.emplace_back();
+	layerElevations.push_back(0.0);
+	layerDrawGroups.push_back(0);
+	layerStates.emplace_back();
+	++drawOrderRevision;
+	++changeGeneration;
+	return handleAt(denseIndex);
+}
+
+inline QuarterLayerPtr QuarterView::newLayer(const Size& resolution, LayerType type, double elevation, const Vec2& position)
+{
+	if (pLayerSource)
+	{
+		return pLayerSource->newLayer(resolution, type, elevation, position);
+	}
+
+	const QuarterLayerPtr handle = allocateSlot();
+	layers.emplace_back(*this, handle.slotIndex, type, resolution, position, elevation, Vec2::One());
+
+	//最初の render() までは描画が必要なレイヤーとして数える
+	++unrenderedDueLayerCount;
+	return handle;
+}
+
+inline QuarterLayerPtr QuarterView::newImageLayer(const Image& image, LayerType type, double elevation, const Vec2& position)
+{
+	if (pLayerSource)
+	{
+		return pLayerSource->newImageLayer(image, type, elevation, position);
+	}
+
+	const QuarterLayerPtr handle = allocateSlot();
+	layers.emplace_back(*this, handle.slotIndex, type, image, position, elevation, Vec2::One());
+	return handle;
+}
+
+inline Array<QuarterLayerPtr> QuarterView::newLayers(size_t count, const Size& resolution, LayerType type, std::function<void(size_t, QuarterLayer&)> initializer)
+{
+	if (pLayerSource)
+	{
+		return pLayerSource->newLayers(count, resolution, type, initializer);
+	}
+
+	reserve(layers.size() + count);
+
+	Array<QuarterLayerPtr> handles;
+	handles.reserve(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		handles.push_back(newLayer(resolution, type));
+		if (initializer)
+		{
+			initializer(i, layers.back());
+		}
+	}
+	return handles;
+}
+
+inline void QuarterView::reserve(size_t layerCount)
+{
+	if (pLayerSource)
+	{
+		pLayerSource->reserve(layerCount);
+		return;
+	}
+
+	layers.reserve(layerCount);
+	layerTransforms.reserve(layerCount);
+	layerElevations.reserve(layerCount);
+	layerDrawGroups.reserve(layerCount);
+	layerStates.reserve(layerCount);
+	denseSlotIndices.reserve(layerCount);
+	layerSlots.reserve(layerCount);
+}
+
+inline void QuarterView::erase(QuarterLayerPtr eraseLayer)
+{
+	if (pLayerSource)
+	{
+		pLayerSource->erase(eraseLayer);
+		return;
+	}
+
+	if (!isValid(eraseLayer))
+	{
+		return;
+	}
+
+	//末尾のレイヤーを空いた位置に移して詰める
+	LayerSlot& slot = layerSlots[eraseLayer.slotIndex];
+	const uint32 denseIndex = slot.denseIndex;
+	const LayerState& erasedState = layerStates[denseIndex];
+	if (erasedState.renderDue && !erasedState.rendered && !erasedState.imageLayer)
+	{
+		--unrenderedDueLayerCount;
+	}
+	const uint32 lastIndex = static_cast<uint32>(layers.size() - 1);
+	if (denseIndex != lastIndex)
+	{
+		layers[denseIndex] = std::move(layers[lastIndex]);
+		layerTransforms[denseIndex] = layerTransforms[lastIndex];
+		layerElevations[denseIndex] = layerElevations[lastIndex];
+		layerDrawGroups[denseIndex] = layerDrawGroups[lastIndex];
+		layerStates[denseIndex] = layerStates[lastIndex];
+		denseSlotIndices[denseIndex] = denseSlotIndices[lastIndex];
+		layerSlots[denseSlotIndices[denseIndex]].denseIndex = denseIndex;
+	}
+	layers.pop_back();
+	layerTransforms.pop_back();
+	layerElevations.pop_back();
+	layerDrawGroups.pop_back();
+	layerStates.pop_back();
+	denseSlotIndices.pop_back();
+
+	++slot.generation;
+	freeSlotIndices.push_back(eraseLayer.slotIndex);
+	++drawOrderRevision;
+	++changeGeneration;
+
+	invalidateImpostors();
+}
+
+inline void QuarterView::update()
+{
+	averageFrameSec = Math::Lerp(averageFrameSec, Scene::DeltaTime(), 0.1);
+
+	//レイヤーの更新は共有元の update() が行う
+	if (pLayerSource)
+	{
+		return;
+	}
+
+	++frameCount;
+
+	//描画先を確保し直したレイヤーが同じフレームで render() 対象になるように、間隔の判定より先に行う
+	const int32 oldQuality = quality;
+	updateQuality();
+	if (quality != oldQuality || frameCount % 30 == 0)
+	{
+		updateBackingScales();
+	}
+
+	if (frameCount % 15 == 0)
+	{
+		updateRenderSchedule();
+	}
+
+	dueLayers.clear();
+	unrenderedDueLayerCount = 0;
+	const uint32 qualityInterval = qualityRenderInterval();
+	for (size_t i = 0; i < layers.size(); ++i)
+	{
+		LayerState& state = layerStates[i];
+		setRenderInterval(state, state.scheduledInterval * qualityInterval);
+
+		//内容を持たないレイヤー (作成直後や描画先の確保し直し後) は間隔によらず毎フレーム対象にする
+		const bool due = !state.hasContents || (!state.retainContents && (frameCount + state.renderPhase) % state.renderInterval == 0);
+		state.renderDue = due;
+		if (due)
+		{
+			state.rendered = false;
+			if (!state.imageLayer)
+			{
+				++unrenderedDueLayerCount;
+			}
+		}
+
+		//本体に触れるのは移動中のレイヤーだけ
+		if (state.moving)
+		{
+			layers[i].updateTransition();
+		}
+
+		if (due && !state.imageLayer)
+		{
+			dueLayers.push_back(handleAt(i));
+		}
+	}
+}
+
+inline void QuarterView::updateRenderSchedule()
+{
+	if (!renderScheduling)
+	{
+		for (auto& state : layerStates)
+		{
+			state.scheduledInterval = 1;
+		}
+		return;
+	}
+
+	const double sceneArea = viewSize().x * viewSize().y;
+	const double sceneRadius = viewSize().length() * 0.5;
+	const QuarterLayer* pFocused = focusedLayer();
+	const Vec2 focusPos = pFocused ? screenCenter(*pFocused) : viewCenter();
+
+	for (size_t i = 0; i < layers.size(); ++i)
+	{
+		const QuarterLayer& layer = layers[i];
+		//画面の 1/4 以上を占めるレイヤーは毎フレーム、それより小さいと面積の平方根に比例して間隔を伸ばす
+		const double sizeImportance = Min(1.0, Math::Sqrt(screenQuad(layer).area() * 4.0 / Max(1.0, sceneArea)));
+		const double distanceImportance = 1.0 / (1.0 + screenCenter(layer).distanceFrom(focusPos) / Max(1.0, sceneRadius));
+		const double importance = layer.renderPriority * sizeImportance * distanceImportance;
+
+		//間隔は2の累乗にそろえて、フレームごとの負荷を均しやすくする
+		uint32 interval = 1;
+		while (interval < maxRenderInterval && interval * importance < 0.5)
+		{
+			interval *= 2;
+		}
+		layerStates[i].scheduledInterval = interval;
+	}
+}
+
+inline void QuarterView::setRenderInterval(LayerState& state, uint32 interval)
+{
+	if (state.renderInterval == interval)
+	{
+		return;
+	}
+
+	//同じ間隔のレイヤー同士で位相を順番に割り当てて、各フレームに均等に振り分ける
+	size_t bucket = 0;
+	while ((2u << bucket) <= interval && bucket + 1 < renderPhaseCounters.size())
+	{
+		++bucket;
+	}
+	state.renderInterval = interval;
+	state.renderPhase = renderPhaseCounters[bucket]++ % interval;
+}
+
+inline void QuarterView::setFocusedLayer(const QuarterLayer& layer)
+{
+	if (pLayerSource)
+	{
+		return;
+	}
+
+	if (!layers.empty() && layers.data() <= &layer && &layer < layers.data() + layers.size())
+	{
+		focusedLayerHandle = handleAt(&layer - layers.data());
+	}
+}
+
+inline const QuarterLayer* QuarterView::focusedLayer()const
+{
+	return isValid(focusedLayerHandle) ? &layers[layerSlots[focusedLayerHandle.slotIndex].denseIndex] : nullptr;
+}
+
+inline void QuarterView::updateQuality()
+{
+	if (frameBudget <= 0.0)
+	{
+		quality = 0;
+		return;
+	}
+
+	if (frameBudget < averageFrameSec)
+	{
+		underBudgetFrames = 0;
+		if (30 <= ++overBudgetFrames && quality < MaxQualityLevel)
+		{
+			++quality;
+			overBudgetFrames = 0;
+		}
+	}
+	else if (averageFrameSec < frameBudget * 0.7)
+	{
+		overBudgetFrames = 0;
+		if (120 <= ++underBudgetFrames && 0 < quality)
+		{
+			--quality;
+			underBudgetFrames = 0;
+		}
+	}
+	else
+	{
+		overBudgetFrames = 0;
+		underBudgetFrames = 0;
+	}
+}
+
+inline void QuarterView::updateBackingScales()
+{
+	std::vector<const QuarterView*> views = { this };
+	views.insert(views.end(), sharingViews.begin(), sharingViews.end());
+
+	for (auto& layer : layers)
+	{
+		double newScale = 1.0;
+		if (1 <= quality && !layer.isImageLayer())
+		{
+			//画面上の面積が解像度に比べて小さいほど低い解像度で十分
+			//共有している視点のうち、最も大きく映っている視点に合わせる
+			double coverage = 0.0;
+			bool onScreen = false;
+			for (const QuarterView* pView : views)
+			{
+				const Quad quad = pView->screenQuad(layer);
+				coverage = Max(coverage, quad.area() / Max(1, layer.width() * layer.height()));
+				onScreen = onScreen || quad.intersects(RectF(pView->viewSize()));
+			}
+
+			//しきい値の付近でテクスチャを確保し直し続けないように、今の倍率から変えるときだけ余裕を持たせる
+			const double currentScale = layer.getBackingScale();
+			const auto isBelow = [&](double threshold, double scaleBelow) { return coverage < threshold * (currentScale <= scaleBelow ? 1.25 : 0.8); };
+
+			if (!onScreen || (2 <= quality && isBelow(0.0625, 0.25)))
+			{
+				newScale = 0.25;
+			}
+			else if (isBelow(0.25, 0.5))
+			{
+				newScale = 0.5;
+			}
+		}
+		layer.setBackingScale(newScale);
+	}
+}
+
+inline void QuarterView::resolve()
+{
+	if (pLayerSource)
+	{
+		pLayerSource->resolve();
+		return;
+	}
+
+	skippedResolve = false;
+	for (size_t i = 0; i < layers.size(); ++i)
+	{
+		if (layerStates[i].pendingUpload)
+		{
+			layers[i].upload();
+		}
+	}
+
+	if (std::any_of(layerStates.begin(), layerStates.end(), [](const LayerState& state) { return !state.resolved; }))
+	{
+		Graphics2D::Flush();
+		for (size_t i = 0; i < layers.size(); ++i)
+		{
+			if (layerStates[i].resolved)
+			{
+				continue;
+			}
+			if (isResolveSkipped(i))
+			{
+				skippedResolve = true;
+				layerStates[i].resolveDeferred = true;
+				continue;
+			}
+			layers[i].resolve();
+		}
+	}
+}
+
+inline bool QuarterView::isResolveSkipped(size_t denseIndex)const
+{
+	//最低品質では resolve を1フレームおきにして、その間は前回の内容を描画する
+	//render() の間隔は偶数フレームになるので、位相をそろえて render() したフレームには必ず resolve する
+	return MaxQualityLevel <= quality && (frameCount + layerStates[denseIndex].renderPhase) % 2 == 1;
+}
+
+inline void QuarterView::beginFrame()
+{
+	hasDrawPlan = true;
+	drawPlanFrame = owner().frameCount;
+	drawPlanOrderRevision = owner().drawOrderRevision;
+	drawPlan.clear();
+
+	if (owner().layers.empty())
+	{
+		return;
+	}
+
+	resolve();
+	bakeImpostors();
+	drawPlan = collectDrawItems();
+}
+
+inline const Array<QuarterView::DrawItem>& QuarterView::currentDrawPlan()
+{
+	if (!hasDrawPlan || drawPlanFrame != owner().frameCount || drawPlanOrderRevision != owner().drawOrderRevision)
+	{
+		beginFrame();
+	}
+	return drawPlan;
+}
+
+inline void QuarterView::resolveItems(const DrawItem* first, const DrawItem* last, int32 beginGroupIndex, size_t drawGroupCount)
+{
+	//描画順を作った後に render() されたレイヤーだけを resolve する
+	QuarterView& source = owner();
+	bool flushed = false;
+	for (auto it = first; it != last; ++it)
+	{
+		if (!it->pLayer || !IsDrawnInRange(*it, beginGroupIndex, drawGroupCount))
+		{
+			continue;
+		}
+
+		const size_t denseIndex = it->pLayer - source.layers.data();
+		QuarterLayer& layer = source.layers[denseIndex];
+		if (source.layerStates[denseIndex].pendingUpload)
+		{
+			layer.upload();
+		}
+		if (!layer.isResolved() && source.isResolveSkipped(denseIndex))
+		{
+			source.skippedResolve = true;
+			source.layerStates[denseIndex].resolveDeferred = true;
+		}
+		else if (!layer.isResolved())
+		{
+			if (!flushed)
+			{
+				Graphics2D::Flush();
+				flushed = true;
+			}
+			layer.resolve();
+		}
+	}
+}
+
+inline bool QuarterView::isIdle()const
+{
+	const QuarterView& source = owner();
+	if (!hasDrawn || source.skippedResolve || source.changeGeneration != drawnChangeGeneration)
+	{
+		return false;
+	}
+
+	if (origin != drawnOrigin || angleAxisX != drawnAngleAxisX || angleAxisZ != drawnAngleAxisZ || zoom != drawnZoom || viewSize().asPoint() != drawnViewSize)
+	{
+		return false;
+	}
+
+	//render() が必要なのに描かれなかったレイヤーは表示から消える
+	return source.unrenderedDueLayerCount == 0;
+}
+
+inline void QuarterView::recordDrawnState()
+{
+	hasDrawn = true;
+	drawnChangeGeneration = owner().changeGeneration;
+	drawnOrigin = origin;
+	drawnAngleAxisX = angleAxisX;
+	drawnAngleAxisZ = angleAxisZ;
+	drawnZoom = zoom;
+	drawnViewSize = viewSize().asPoint();
+}
+
+inline void QuarterView::draw()
+{
+	if (retainedComposition)
+	{
+		drawRetained();
+		recordDrawnState();
+		return;
+	}
+	drawPartial(std::numeric_limits<int32>::min(), -1);
+}
+
+inline void QuarterView::drawPartial(int32 beginGroupIndex, size_t drawGroupCount)
+{
+	const auto& plan = currentDrawPlan();
+
+	//描画順は drawGroup ごとにまとまっているので、範囲の両端を二分探索で求める
+	const auto groupLess = [](const DrawItem& item, int64 groupIndex) { return item.drawGroup < groupIndex; };
+	const DrawItem* first = std::lower_bound(plan.data(), plan.data() + plan.size(), static_cast<int64>(beginGroupIndex), groupLess);
+	const DrawItem* last = drawGroupCount == static_cast<size_t>(-1) ? plan.data() + plan.size() : std::lower_bound(first, plan.data() + plan.size(), beginGroupIndex + static_cast<int64>(drawGroupCount), groupLess);
+	if (first == last)
+	{
+		recordDrawnState();
+		return;
+	}
+
+	resolveItems(first, last, beginGroupIndex, drawGroupCount);
+
+	Optional<ScopedViewport2D> viewportScope;
+	if (viewport)
+	{
+		viewportScope.emplace(*viewport);
+	}
+
+	for (auto it = first; it != last; ++it)
+	{
+		if (IsDrawnInRange(*it, beginGroupIndex, drawGroupCount))
+		{
+			drawItem(*it);
+		}
+	}
+
+	//遅れて届いた resolve による変化も含めて、描画し終えた状態を覚える
+	recordDrawnState();
+}
+
+inline QuarterImpostorPtr QuarterView::newImpostor(int32 beginGroupIndex, size_t drawGroupCount)
+{
+	impostors.push_back(std::make_shared<QuarterImpostor>(beginGroupIndex, drawGroupCount));
+	hasDrawPlan = false;
+	markChanged();
+	return impostors.back();
+}
+
+inline void QuarterView::erase(QuarterImpostorPtr eraseImpostor)
+{
+	if (eraseImpostor && eraseImpostor->composed)
+	{
+		addDamage(eraseImpostor->composedBounds);
+	}
+	impostors.erase(std::remove_if(impostors.begin(), impostors.end(), [&](QuarterImpostorPtr p) { return p == eraseImpostor; }), impostors.end());
+	hasDrawPlan = false;
+	markChanged();
+}
+
+inline void QuarterView::invalidateImpostors()
+{
+	for (auto& pImpostor : impostors)
+	{
+		pImpostor->invalidate();
+	}
+}
+
+inline std::vector<const QuarterImpostor*> QuarterView::collectBakedImpostors()const
+{
+	const QuarterView& source = owner();
+	std::vector<const QuarterImpostor*> bakedInto(source.layers.size(), nullptr);
+	for (const auto& pImpostor : impostors)
+	{
+		if (!pImpostor->isBaked())
+		{
+			continue;
+		}
+		for (const auto& member : pImpostor->members)
+		{
+			if (isValid(member.first))
+			{
+				const QuarterImpostor*& pBakedInto = bakedInto[source.layerSlots[member.first.slotIndex].denseIndex];
+				if (!pBakedInto)
+				{
+					pBakedInto = pImpostor.get();
+				}
+			}
+		}
+	}
+	return bakedInto;
+}
+
+inline bool QuarterView::CoversImpostor(int32 beginGroupIndex, size_t drawGroupCount, const QuarterImpostor& impostor)
+{
+	if (impostor.beginGroupIndex() < beginGroupIndex)
+	{
+		return false;
+	}
+	if (drawGroupCount == static_cast<size_t>(-1))
+	{
+		return true;
+	}
+	return impostor.drawGroupCount() != static_cast<size_t>(-1) && impostor.beginGroupIndex() + static_cast<int64>(impostor.drawGroupCount()) <= beginGroupIndex + static_cast<int64>(drawGroupCount);
+}
+
+inline bool QuarterView::IsDrawnInRange(const DrawItem& item, int32 beginGroupIndex, size_t drawGroupCount)
+{
+	if (item.pImpostor)
+	{
+		return CoversImpostor(beginGroupIndex, drawGroupCount, *item.pImpostor);
+	}
+	if (!item.pLayer->isVisible() || !item.pLayer->isRendered())
+	{
+		return false;
+	}
+	return !item.pBakedInto || !CoversImpostor(beginGroupIndex, drawGroupCount, *item.pBakedInto);
+}
+
+inline bool QuarterView::needsBake(const QuarterImpostor& impostor)const
+{
+	if (impostor.dirty || impostor.angleAxisX != angleAxisX || impostor.angleAxisZ != angleAxisZ || impostor.zoom != zoom)
+	{
+		return true;
+	}
+
+	//メンバーの増減・再描画・移動を検出する
+	const QuarterView& source = owner();
+	const auto& layers = source.layers;
+	const auto& denseSlotIndices = source.denseSlotIndices;
+	const auto& layerSlots = source.layerSlots;
+	size_t memberIndex = 0;
+	for (size_t i = 0; i < layers.size(); ++i)
+	{
+		const LayerState& state = source.layerStates[i];
+		if (!IsImpostorMember(state) || !impostor.contains(source.layerDrawGroups[i]))
+		{
+			continue;
+		}
+		if (impostor.members.size() <= memberIndex)
+		{
+			return true;
+		}
+		const auto& member = impostor.members[memberIndex++];
+		if (member.first.slotIndex != denseSlotIndices[i] || member.first.generation != layerSlots[denseSlotIndices[i]].generation || member.second != state.revision)
+		{
+			return true;
+		}
+	}
+
+	return memberIndex != impostor.members.size();
+}
+
+inline void QuarterView::bake(QuarterImpostor& impostor)
+{
+	impostor.dirty = false;
+	impostor.angleAxisX = angleAxisX;
+	impostor.angleAxisZ = angleAxisZ;
+	impostor.zoom = zoom;
+	impostor.members.clear();
+
+	QuarterView& source = owner();
+	Array<const QuarterLayer*> members;
+	for (size_t i = 0; i < source.layers.size(); ++i)
+	{
+		const LayerState& state = source.layerStates[i];
+		if (IsImpostorMember(state) && impostor.contains(source.layerDrawGroups[i]))
+		{
+			impostor.members.emplace_back(source.handleAt(i), state.revision);
+			members.push_back(&source.layers[i]);
+		}
+	}
+
+	if (members.isEmpty())
+	{
+		impostor.baked = false;
+		return;
+	}
+
+	//origin を基準とした画面上の範囲
+	Vec2 minPos = Vec2::One() * Math::Inf;
+	Vec2 maxPos = -Vec2::One() * Math::Inf;
+	for (const auto& member : members)
+	{
+		const RectF rect = screenQuad(*member).boundingRect();
+		minPos = Vec2(Min(minPos.x, rect.x), Min(minPos.y, rect.y));
+		maxPos = Vec2(Max(maxPos.x, rect.br().x), Max(maxPos.y, rect.br().y));
+	}
+	minPos = Vec2(Math::Floor(minPos.x - origin.x), Math::Floor(minPos.y - origin.y));
+	maxPos = Vec2(Math::Ceil(maxPos.x - origin.x), Math::Ceil(maxPos.y - origin.y));
+
+	const Size textureSize = (maxPos - minPos).asPoint();
+	if (QuarterImpostor::MaxTextureSize < Max(textureSize.x, textureSize.y))
+	{
+		//大きすぎる場合はレイヤーごとに描画する
+		impostor.baked = false;
+		return;
+	}
+
+	impostor.offset = minPos;
+	if (impostor.texture.size() != textureSize)
+	{
+		impostor.texture = RenderTexture(textureSize);
+	}
+	impostor.texture.clear(Alpha(0));
+
+	//draw() と同じく drawGroup、elevation の順に重ねる
+	members.sort_by([](const QuarterLayer* a, const QuarterLayer* b) { return a->getDrawGroup() != b->getDrawGroup() ? a->getDrawGroup() < b->getDrawGroup() : a->getElevation() < b->getElevation(); });
+
+	{
+		ScopedRenderTarget2D target(impostor.texture);
+		ScopedRenderStates2D blend(BlendState(true, Blend::SrcAlpha, Blend::InvSrcAlpha, BlendOp::Add, Blend::One, Blend::InvSrcAlpha));
+		for (const auto& member : members)
+		{
+			Transformer2D t(member->getMat(*this).translated(-origin - minPos));
+			member->drawContents();
+		}
+	}
+
+	Graphics2D::Flush();
+	impostor.baked = true;
+	++impostor.bakeCount;
+}
+
+inline void QuarterView::bakeImpostors()
+{
+	for (auto& pImpostor : impostors)
+	{
+		if (needsBake(*pImpostor))
+		{
+			bake(*pImpostor);
+		}
+	}
+}
+
+inline Array<QuarterView::DrawItem> QuarterView::collectDrawItems()const
+{
+	const QuarterView& source = owner();
+	const auto& layers = source.layers;
+	const auto& elevations = source.layerElevations;
+	const auto minMaxElevation = std::minmax_element(elevations.begin(), elevations.end());
+	const double minElevation = *minMaxElevation.first;
+	const double maxElevation = *minMaxElevation.second;
+
+	//すべてのレイヤーとインポスタを drawGroup, elevation の順に並べる
+	//焼き込まれたレイヤーも、インポスタの範囲の一部だけを描画するときのために残しておく
+	const std::vector<const QuarterImpostor*> bakedInto = collectBakedImpostors();
+	Array<DrawItem> items;
+	items.reserve(layers.size() + impostors.size());
+	for (size_t i = 0; i < layers.size(); ++i)
+	{
+		const int32 drawGroup = source.layerDrawGroups[i];
+		const double elevation01 = minElevation < maxElevation ? Math::InvLerp(minElevation, maxElevation, elevations[i]) : 0.0;
+		items.push_back(DrawItem{ drawGroup, elevation01, &layers[i], nullptr, bakedInto[i] });
+	}
+	for (const auto& pImpostor : impostors)
+	{
+		if (pImpostor->isBaked())
+		{
+			items.push_back(DrawItem{ pImpostor->beginGroupIndex(), 0.0, nullptr, pImpostor.get(), nullptr });
+		}
+	}
+
+	std::stable_sort(items.begin(), items.end(), [](const DrawItem& a, const DrawItem& b) { return a.drawGroup != b.drawGroup ? a.drawGroup < b.drawGroup : a.order < b.order; });
+
+	return items;
+}
+
+inline void QuarterView::drawItem(const DrawItem& item)const
+{
+	if (item.pImpostor)
+	{
+		item.pImpostor->texture.draw(origin + item.pImpostor->offset);
+	}
+	else
+	{
+		Transformer2D t(item.pLayer->getMat(*this));
+		item.pLayer->drawContents();
+	}
+}
+
+inline void QuarterView::addDamage(const RectF& rect)
+{
+	const Point sceneSize = viewSize().asPoint();
+	const int32 left = Max(static_cast<int32>(Math::Floor(rect.x)), 0);
+	const int32 top = Max(static_cast<int32>(Math::Floor(rect.y)), 0);
+	const int32 right = Min(static_cast<int32>(Math::Ceil(rect.x + rect.w)), sceneSize.x);
+	const int32 bottom = Min(static_cast<int32>(Math::Ceil(rect.y + rect.h)), sceneSize.y);
+	if (left < right && top < bottom)
+	{
+		damagedRects.emplace_back(left, top, right - left, bottom - top);
+	}
+}
+
+inline Array<RectF> QuarterView::collectDamage(const Array<DrawItem>& items)
+{
+	const QuarterView& source = owner();
+	const auto& layers = source.layers;
+
+	//視点や描画範囲の大きさが変わったら全体を描き直す
+	//レイヤーの画面上の範囲は、視点が変わるか markChanged() されない限り revision が変わったレイヤーだけ求め直す
+	bool boundsChanged = composedMarkedChangeCount != source.markedChangeCount;
+	composedMarkedChangeCount = source.markedChangeCount;
+	const Size compositeSize = viewSize().asPoint();
+	if (composite.size() != compositeSize || composedOrigin != origin || composedAngleAxisX != angleAxisX || composedAngleAxisZ != angleAxisZ || composedZoom != zoom)
 	{
-		switch (type)
+		boundsChanged = true;
+		if (composite.size() != compositeSize)
 		{
-		case LayerType::Z:
-			return _z;
-		case LayerType::X:
-			return _x;
-		default:
-			return _y;
+			composite = RenderTexture(compositeSize);
 		}
+		composedOrigin = origin;
+		composedAngleAxisX = angleAxisX;
+		composedAngleAxisZ = angleAxisZ;
+		composedZoom = zoom;
+		damagedRects.clear();
+		addDamage(RectF(compositeSize));
 	}
 
-	const Transitional<double>& elevationValue()const
+	std::vector<bool> drawn(layers.size(), false);
+	for (const auto& item : items)
 	{
-		switch (type)
+		if (item.pLayer && IsDrawnInRange(item, std::numeric_limits<int32>::min(), -1))
 		{
-		case LayerType::Z:
-			return _z;
-		case LayerType::X:
-			return _x;
-		default:
-			return _y;
+			drawn[item.pLayer - layers.data()] = true;
 		}
 	}
 
-	void resolve()
+	//erase() されたレイヤーの範囲を描き直す
+	composedStates.resize(source.layerSlots.size());
+	for (size_t slotIndex = 0; slotIndex < composedStates.size(); ++slotIndex)
 	{
-		if (!resolved)
+		ComposedState& state = composedStates[slotIndex];
+		if (state.composed && state.generation != source.layerSlots[slotIndex].generation)
 		{
-			texture.resolve();
-			resolved = true;
+			addDamage(state.bounds);
+			state = ComposedState();
+			state.generation = source.layerSlots[slotIndex].generation;
 		}
 	}
 
-	friend class QuarterView;
-
-	std::reference_wrapper<const QuarterView> quarterViewRef;
-
-	Color backGroundColor = Alpha(0);
-	bool resolved = true;
-	bool rendered = false;
+	//前回合成したときから内容・位置・順番が変わったものの新旧の範囲を描き直す
+	for (size_t i = 0; i < layers.size(); ++i)
+	{
+		const QuarterLayer& layer = layers[i];
+		ComposedState& state = composedStates[source.denseSlotIndices[i]];
+		const uint32 revision = source.layerStates[i].revision;
+		const int32 drawGroup = source.layerDrawGroups[i];
+		if (!boundsChanged && state.composed == drawn[i] && state.revision == revision && state.drawGroup == drawGroup)
+		{
+			continue;
+		}
 
-	Transitional<double> _x, _y, _z;
-	Transitional<Vec2> scale;
-};
+		const RectF bounds = drawn[i] ? screenQuad(layer).boundingRect() : RectF();
+		if (state.composed != drawn[i] || (drawn[i] && (state.bounds != bounds || state.revision != revision || state.drawGroup != drawGroup)))
+		{
+			if (state.composed)
+			{
+				addDamage(state.bounds);
+			}
+			if (drawn[i])
+			{
+				addDamage(bounds);
+			}
+		}
+		state.composed = drawn[i];
+		state.bounds = bounds;
+		state.revision = revision;
+		state.drawGroup = drawGroup;
+	}
 
-inline void QuarterView::update()
-{
-	for (auto& pLayer : layers)
+	for (auto& pImpostor : impostors)
 	{
-		pLayer->update();
+		QuarterImpostor& impostor = *pImpostor;
+		const bool composedNow = impostor.isBaked();
+		const RectF bounds = composedNow ? RectF(origin + impostor.offset, impostor.texture.size()) : RectF();
+		if (impostor.composed != composedNow || (composedNow && (impostor.composedBounds != bounds || impostor.composedBakeCount != impostor.bakeCount)))
+		{
+			if (impostor.composed)
+			{
+				addDamage(impostor.composedBounds);
+			}
+			if (composedNow)
+			{
+				addDamage(bounds);
+			}
+		}
+		impostor.composed = composedNow;
+		impostor.composedBounds = bounds;
+		impostor.composedBakeCount = impostor.bakeCount;
 	}
-}
 
-inline void QuarterView::resolve()
-{
-	if (std::any_of(layers.begin(), layers.end(), [](const QuarterLayerPtr& layer) { return !layer->isResolved(); }))
+	Array<RectF> itemBounds;
+	itemBounds.reserve(items.size());
+	for (const auto& item : items)
 	{
-		Graphics2D::Flush();
-		for (auto& pLayer : layers)
+		if (!IsDrawnInRange(item, std::numeric_limits<int32>::min(), -1))
 		{
-			pLayer->resolve();
+			itemBounds.emplace_back();
+			continue;
 		}
+		itemBounds.push_back(item.pLayer ? composedStates[source.denseSlotIndices[item.pLayer - layers.data()]].bounds : item.pImpostor->composedBounds);
 	}
+	return itemBounds;
 }
 
-inline void QuarterView::draw()
+inline Array<Rect> QuarterView::mergeDamage()
 {
-	resolve();
-
-	const auto getI = [&](size_t index)->QuarterLayer&
+	Array<Rect> regions;
+	for (const auto& rect : damagedRects)
 	{
-		auto it = layers.begin();
-		for (size_t i = 0; i < index; ++i)
+		Rect merged = rect;
+		//重なる範囲は1つにまとめる
+		for (bool overlapped = true; overlapped;)
 		{
-			++it;
+			overlapped = false;
+			for (size_t i = 0; i < regions.size(); ++i)
+			{
+				if (regions[i].intersects(merged))
+				{
+					const int32 right = Max(merged.x + merged.w, regions[i].x + regions[i].w);
+					const int32 bottom = Max(merged.y + merged.h, regions[i].y + regions[i].h);
+					merged.x = Min(merged.x, regions[i].x);
+					merged.y = Min(merged.y, regions[i].y);
+					merged.w = right - merged.x;
+					merged.h = bottom - merged.y;
+					regions.remove_at(i);
+					overlapped = true;
+					break;
+				}
+			}
 		}
-		return *it->get();
-	};
-
-	using IndexElevation = std::pair<size_t, double>;
+		regions.push_back(merged);
+	}
+	damagedRects.clear();
 
-	const auto minMaxElevation = std::minmax_element(layers.begin(), layers.end(), [](QuarterLayerPtr a, QuarterLayerPtr b) { return a->getElevation() < b->getElevation(); });
-	const double minElevation = (*minMaxElevation.first)->getElevation();
-	const double maxElevation = (*minMaxElevation.second)->getElevation();
+	//範囲が多すぎる場合や画面の大半を占める場合は全体を1回で描き直す
+	int64 area = 0;
+	for (const auto& region : regions)
+	{
+		area += static_cast<int64>(region.w) * region.h;
+	}
+	const Point sceneSize = viewSize().asPoint();
+	const int64 sceneArea = static_cast<int64>(sceneSize.x) * sceneSize.y;
+	if (MaxDamageRegions < regions.size() || sceneArea < area * 2)
+	{
+		regions = { Rect(sceneSize) };
+	}
 
-	auto indices = Array<IndexElevation>::IndexedGenerate(layers.size(),
-		[&](size_t i) {
-			auto& layer = getI(i);
-			return IndexElevation(i, layer.drawGroup + Math::InvLerp(minElevation, maxElevation, layer.getElevation()));
-		}
-	).filter([&](const IndexElevation& index) { return getI(index.first).isRendered(); }
-	);
+	return regions;
+}
 
-	indices.sort_by([&](const IndexElevation& a, const IndexElevation& b) { return a.second < b.second; });
+inline bool QuarterView::isCompositeCurrent()const
+{
+	const QuarterView& source = owner();
+	if (!hasComposite || !damagedRects.empty() || source.skippedResolve || source.changeGeneration != composedChangeGeneration)
+	{
+		return false;
+	}
 
-	for (const auto& index : indices)
+	if (composite.size() != viewSize().asPoint() || composedOrigin != origin || composedAngleAxisX != angleAxisX || composedAngleAxisZ != angleAxisZ || composedZoom != zoom)
 	{
-		const QuarterLayer& layer = getI(index.first);
-		//auto t = createTransformer2D(layer);
-		auto t = layer.renderDirectly(false);
-		layer.texture.draw();
+		return false;
 	}
+
+	//render() が必要なのに描かれなかったレイヤーは、合成結果から消さなければならない
+	return source.unrenderedDueLayerCount == 0;
 }
 
-inline void QuarterView::drawPartial(int32 beginGroupIndex, size_t drawGroupCount)
+inline void QuarterView::updateComposite()
 {
-	resolve();
+	const auto& items = currentDrawPlan();
+	resolveItems(items.data(), items.data() + items.size(), std::numeric_limits<int32>::min(), -1);
+	const auto itemBounds = collectDamage(items);
 
-	const auto getI = [&](size_t index)->QuarterLayer&
+	if (!damagedRects.empty())
 	{
-		auto it = layers.begin();
-		for (size_t i = 0; i < index; ++i)
+		const Rect oldScissorRect = Graphics2D::GetScissorRect();
+		ScopedRenderTarget2D target(composite);
+
+		for (const auto& region : mergeDamage())
 		{
-			++it;
+			{
+				//範囲内を透明に戻す
+				ScopedRenderStates2D blend(BlendState(false));
+				region.draw(ColorF(0.0, 0.0));
+			}
+
+			Graphics2D::SetScissorRect(region);
+			ScopedRenderStates2D states(BlendState(true, Blend::SrcAlpha, Blend::InvSrcAlpha, BlendOp::Add, Blend::One, Blend::InvSrcAlpha), RasterizerState(FillMode::Solid, CullMode::None, true));
+			for (size_t i = 0; i < items.size(); ++i)
+			{
+				if (IsDrawnInRange(items[i], std::numeric_limits<int32>::min(), -1) && itemBounds[i].intersects(region))
+				{
+					drawItem(items[i]);
+				}
+			}
 		}
-		return *it->get();
-	};
 
-	using IndexElevation = std::pair<size_t, double>;
+		Graphics2D::Flush();
+		Graphics2D::SetScissorRect(oldScissorRect);
+	}
 
-	const auto minMaxElevation = std::minmax_element(layers.begin(), layers.end(), [](QuarterLayerPtr a, QuarterLayerPtr b) { return a->getElevation() < b->getElevation(); });
-	const double minElevation = (*minMaxElevation.first)->getElevation();
-	const double maxElevation = (*minMaxElevation.second)->getElevation();
+	hasComposite = true;
+	composedChangeGeneration = owner().changeGeneration;
+}
 
-	auto indices = Array<IndexElevation>::IndexedGenerate(layers.size(),
-		[&](size_t i) {
-			auto& layer = getI(i);
-			return IndexElevation(i, layer.drawGroup + Math::InvLerp(minElevation, maxElevation, layer.getElevation()));
-		}
-	).filter([&](const IndexElevation& index) { const int32 groupIndex = getI(index.first).drawGroup; return getI(index.first).isRendered() && beginGroupIndex <= groupIndex && (drawGroupCount == -1 || groupIndex < beginGroupIndex + static_cast<int32>(drawGroupCount)); }
-	);
+inline void QuarterView::drawRetained()
+{
+	if (owner().layers.empty())
+	{
+		return;
+	}
 
-	indices.sort_by([&](const IndexElevation& a, const IndexElevation& b) { return a.second < b.second; });
+	//前回から何も変わっていなければ、描画順を作らずに合成結果をそのまま使う
+	if (!isCompositeCurrent())
+	{
+		updateComposite();
+	}
 
-	for (const auto& index : indices)
 	{
-		const QuarterLayer& layer = getI(index.first);
-		//auto t = createTransformer2D(layer);
-		auto t = layer.renderDirectly(false);
-		layer.texture.draw();
+		Optional<ScopedViewport2D> viewportScope;
+		if (viewport)
+		{
+			viewportScope.emplace(*viewport);
+		}
+
+		//合成結果は乗算済みアルファなので、そのまま重ねる
+		ScopedRenderStates2D blend(BlendState(true, Blend::One, Blend::InvSrcAlpha));
+		composite.draw();
 	}
 }
 
 inline Quad QuarterView::screenQuad(const QuarterLayer& layer)const
 {
 	const auto ps = Array<Vec2>({ Vec2(0, 0), Vec2(layer.width(), 0), Vec2(layer.size()), Vec2(0, layer.height()) })
-		.map([&](const Vec2& p) { return layer.getMat().transform(p); });
+		.map([&](const Vec2& p) { return layer.getMat(*this).transform(p); });
 	return Quad(ps[0], ps[1], ps[2], ps[3]);
 }
 
 inline Quad QuarterView::screenQuad(LayerType LayerType, LayerAlignPos alignType, const Size& layerSize, const Vec2& position, double elevation, const Vec2& scale)const
 {
-	const auto quarterMat = QuarterLayer::GetMat(angleAxisX, angleAxisZ, origin, LayerType, alignType, layerSize, position, scale, elevation);
+	const auto quarterMat = QuarterLayer::GetMat(angleAxisX, angleAxisZ, origin, LayerType, alignType, layerSize, position, scale, elevation)
+		.translated(-origin).scaled(zoom).translated(origin);
 	const auto ps = Array<Vec2>({ Vec2(0, 0), Vec2(layerSize.x, 0), Vec2(layerSize.x, layerSize.y), Vec2(0, layerSize.y) })
 		.map([&](const Vec2& p) { return quarterMat.transform(p); });
 	return Quad(ps[0], ps[1], ps[2], ps[3]);
@@ -662,12 +2777,12 @@ inline Quad QuarterView::screenQuad(LayerType LayerType, LayerAlignPos alignType
 
 inline Vec2 QuarterView::screenCenter(const QuarterLayer& layer)const
 {
-	return layer.getMat().transform(layer.size() * 0.5);
+	return layer.getMat(*this).transform(layer.size() * 0.5);
 }
 
 inline Vec2 QuarterView::screenPos(const QuarterLayer& layer, LayerAlignPos focusPos)const
 {
-	const auto mat = layer.getMat();
+	const auto mat = layer.getMat(*this);
 	switch (focusPos)
 	{
 	case LayerAlignPos::TopLeft:
@@ -696,12 +2811,393 @@ inline Vec2 QuarterView::screenPos(const QuarterLayer& layer, LayerAlignPos focu
 
 inline void QuarterView::focus(const QuarterLayer& layer)
 {
+	setFocusedLayer(layer);
+
 	const Vec2 toOriginFromCenter = origin - screenCenter(layer);
-	origin = Scene::Center() + toOriginFromCenter;
+	origin = viewCenter() + toOriginFromCenter;
 }
 
 inline void QuarterView::focus(const QuarterLayer& layer, LayerAlignPos focusPos)
 {
+	setFocusedLayer(layer);
+
 	const Vec2 toOriginFromCenter = origin - screenPos(layer, focusPos);
-	origin = Scene::Center() + toOriginFromCenter;
+	origin = viewCenter() + toOriginFromCenter;
+}
+
+enum class VolumeFormat { UInt8, UInt16, Float32 };
+
+// ディスク上の生のボリュームデータ (x, y, z の順に x が最も速く変化するスカラー値の並び) を
+// 1軸に沿ったスライスの重なりとして表示する
+// 画面に入っているスライスだけを必要になった時点でファイルから読み込み、限られた数のレイヤーを使い回す
+class QuarterVolume
+{
+public:
+
+	QuarterVolume(QuarterView& quarterView, const FilePath& path, int32 width, int32 height, int32 depth, VolumeFormat format, LayerType sliceAxis = LayerType::Z, size_t poolSize = 32) :
+		quarterViewRef(quarterView),
+		reader(path),
+		volumeWidth(width),
+		volumeHeight(height),
+		volumeDepth(depth),
+		format(format),
+		axis(sliceAxis)
+	{
+		const Image blank(sliceSize());
+		pool.reserve(poolSize);
+		for (size_t i = 0; i < poolSize; ++i)
+		{
+			PoolEntry entry;
+			entry.layer = quarterView.newImageLayer(blank, axis);
+			entry.layer->setVisible(false);
+			pool.push_back(entry);
+		}
+	}
+
+	QuarterVolume(const QuarterVolume&) = delete;
+
+	QuarterVolume& operator=(const QuarterVolume&) = delete;
+
+	~QuarterVolume()
+	{
+		for (const auto& entry : pool)
+		{
+			quarterViewRef.get().erase(entry.layer);
+		}
+	}
+
+	bool isOpen()const { return reader.isOpen(); }
+
+	// スライス1枚の解像度
+	Size sliceSize()const
+	{
+		switch (axis)
+		{
+		case LayerType::Z:
+			return Size(volumeWidth, volumeHeight);
+		case LayerType::X:
+			return Size(volumeDepth, volumeHeight);
+		default:
+			return Size(volumeWidth, volumeDepth);
+		}
+	}
+
+	int32 sliceCount()const
+	{
+		switch (axis)
+		{
+		case LayerType::Z:
+			return volumeDepth;
+		case LayerType::X:
+			return volumeWidth;
+		default:
+			return volumeHeight;
+		}
+	}
+
+	// 現在表示しているスライスの間隔
+	int32 sliceStride()const { return stride; }
+
+	// 表示するスライスを決めて、足りないものを読み込む
+	// quarterView.update() の後に毎フレーム呼ぶ
+	void update();
+
+	// minValue や colorMap を変えたときに呼んで、読み込み済みのスライスを作り直させる
+	void reload()
+	{
+		for (auto& entry : pool)
+		{
+			entry.sliceIndex = -1;
+			entry.layer->setVisible(false);
+		}
+	}
+
+	Vec2 position = Vec2::Zero();
+	double elevation = 0.0;
+	double sliceSpacing = 1.0;
+	int32 drawGroup = 0;
+
+	// この範囲の値を 0～1 にしてから colorMap で色にする
+	double minValue = 0.0;
+	double maxValue = 255.0;
+	std::function<Color(double)> colorMap = [](double value01) { return Color(static_cast<uint8>(value01 * 255), static_cast<uint8>(value01 * 255)); };
+
+	// 画面上でスライス同士がこれより近いときはスライスを間引く [px]
+	double minSliceSpacingPixels = 2.0;
+
+	// 1フレームに読み込むスライスの上限
+	size_t maxSliceLoadsPerFrame = 4;
+
+private:
+
+	struct PoolEntry
+	{
+		QuarterLayerPtr layer;
+		int32 sliceIndex = -1;
+		uint64 lastUsedFrame = 0;
+	};
+
+	size_t bytesPerVoxel()const
+	{
+		switch (format)
+		{
+		case VolumeFormat::UInt16:
+			return 2;
+		case VolumeFormat::Float32:
+			return 4;
+		default:
+			return 1;
+		}
+	}
+
+	double voxelValue(const uint8* p)const
+	{
+		switch (format)
+		{
+		case VolumeFormat::UInt16:
+		{
+			uint16 value;
+			std::memcpy(&value, p, sizeof(value));
+			return value;
+		}
+		case VolumeFormat::Float32:
+		{
+			float value;
+			std::memcpy(&value, p, sizeof(value));
+			return value;
+		}
+		default:
+			return *p;
+		}
+	}
+
+	Color voxelColor(const uint8* p)const
+	{
+		const double value01 = maxValue != minValue ? Clamp((voxelValue(p) - minValue) / (maxValue - minValue), 0.0, 1.0) : 0.0;
+		return colorMap(value01);
+	}
+
+	// 読めなかった部分は 0 で埋める
+	void readBytes(int64 offset, size_t size)
+	{
+		buffer.resize(size);
+		reader.setPos(offset);
+		const int64 readSize = Max<int64>(reader.read(buffer.data(), static_cast<int64>(size)), 0);
+		if (readSize < static_cast<int64>(size))
+		{
+			std::fill(buffer.begin() + readSize, buffer.end(), uint8(0));
+		}
+	}
+
+	double sliceElevation(int32 sliceIndex)const
+	{
+		return elevation + sliceIndex * sliceSpacing;
+	}
+
+	// pool[entryIndices[i]].sliceIndex のスライスを読み込む
+	void loadSlices(const Array<size_t>& entryIndices);
+
+	std::reference_wrapper<QuarterView> quarterViewRef;
+	BinaryReader reader;
+
+	int32 volumeWidth;
+	int32 volumeHeight;
+	int32 volumeDepth;
+	VolumeFormat format;
+	LayerType axis;
+
+	Array<PoolEntry> pool;
+	std::vector<uint8> buffer;
+	int32 stride = 1;
+	uint64 frameCount = 0;
+};
+
+inline void QuarterVolume::update()
+{
+	++frameCount;
+
+	const QuarterView& quarterView = quarterViewRef.get();
+	const int32 count = sliceCount();
+	if (!isOpen() || count <= 0 || pool.isEmpty())
+	{
+		return;
+	}
+
+	const LayerAlignPos alignPos = pool.front().layer->alignPos;
+	const Vec2 scale = pool.front().layer->getScale();
+	const RectF viewRect(quarterView.viewSize());
+	const auto sliceQuad = [&](int32 sliceIndex) { return quarterView.screenQuad(axis, alignPos, sliceSize(), position, sliceElevation(sliceIndex), scale); };
+
+	//画面上のスライスの間隔が狭いときは間引く
+	const double pixelsPerSlice = count < 2 ? Math::Inf : sliceQuad(0).boundingRect().center().distanceFrom(sliceQuad(1).boundingRect().center());
+	stride = 1;
+	while (stride < count && pixelsPerSlice * stride < minSliceSpacingPixels)
+	{
+		stride *= 2;
+	}
+
+	//平行なスライスが画面に映る範囲は連続している
+	int32 firstVisible = -1;
+	int32 lastVisible = -1;
+	for (int32 sliceIndex = 0; sliceIndex < count; sliceIndex += stride)
+	{
+		if (sliceQuad(sliceIndex).intersects(viewRect))
+		{
+			firstVisible = (firstVisible < 0) ? sliceIndex : firstVisible;
+			lastVisible = sliceIndex;
+		}
+	}
+
+	Array<int32> visibleSlices;
+	if (0 <= firstVisible)
+	{
+		//画面に映るスライスがプールに収まらないときは、さらに間引く
+		const auto visibleCount = [&](int32 s) { return lastVisible / s - (firstVisible + s - 1) / s + 1; };
+		while (stride < count && pool.size() < static_cast<size_t>(visibleCount(stride)))
+		{
+			stride *= 2;
+		}
+
+		for (int32 sliceIndex = (firstVisible + stride - 1) / stride * stride; sliceIndex <= lastVisible; sliceIndex += stride)
+		{
+			visibleSlices.push_back(sliceIndex);
+		}
+	}
+
+	//表示するスライスを読み込み済みのレイヤーに割り当てる
+	Array<bool> shown(pool.size(), false);
+
+	Array<int32> missingSlices;
+	for (const int32 sliceIndex : visibleSlices)
+	{
+		const auto it = std::find_if(pool.begin(), pool.end(), [&](const PoolEntry& entry) { return entry.sliceIndex == sliceIndex; });
+		if (it == pool.end())
+		{
+			missingSlices.push_back(sliceIndex);
+			continue;
+		}
+		it->lastUsedFrame = frameCount;
+		shown[it - pool.begin()] = true;
+	}
+
+	//足りないスライスは最も長く使われていないレイヤーに読み込む
+	const size_t loadCount = Min(missingSlices.size(), maxSliceLoadsPerFrame);
+	Array<size_t> loadedEntries;
+	for (size_t i = 0; i < loadCount; ++i)
+	{
+		auto it = std::min_element(pool.begin(), pool.end(), [](const PoolEntry& a, const PoolEntry& b) { return a.lastUsedFrame < b.lastUsedFrame; });
+		if (it->lastUsedFrame == frameCount)
+		{
+			break;
+		}
+		it->sliceIndex = missingSlices[i];
+		it->lastUsedFrame = frameCount;
+		shown[it - pool.begin()] = true;
+		loadedEntries.push_back(it - pool.begin());
+	}
+	loadSlices(loadedEntries);
+
+	//変化のないフレームでは QuarterView の isIdle() を妨げないようにする
+	for (size_t i = 0; i < pool.size(); ++i)
+	{
+		QuarterLayer& layer = *pool[i].layer;
+		layer.setVisible(shown[i]);
+		if (pool[i].sliceIndex < 0)
+		{
+			continue;
+		}
+
+		layer.setDrawGroup(drawGroup);
+		if (layer.getPosition() != position)
+		{
+			layer.setPosition(position);
+		}
+		if (layer.getElevation() != sliceElevation(pool[i].sliceIndex))
+		{
+			layer.setElevation(sliceElevation(pool[i].sliceIndex));
+		}
+	}
+}
+
+inline void QuarterVolume::loadSlices(const Array<size_t>& entryIndices)
+{
+	if (entryIndices.isEmpty())
+	{
+		return;
+	}
+
+	const size_t voxelSize = bytesPerVoxel();
+	const size_t rowBytes = volumeWidth * voxelSize;
+
+	switch (axis)
+	{
+	case LayerType::Z:
+	{
+		//z 一定の面はファイル上で連続している
+		for (const size_t entryIndex : entryIndices)
+		{
+			const int32 sliceIndex = pool[entryIndex].sliceIndex;
+			Image& image = pool[entryIndex].layer->getImage();
+			readBytes(static_cast<int64>(sliceIndex) * volumeHeight * rowBytes, volumeHeight * rowBytes);
+			for (int32 y = 0; y < volumeHeight; ++y)
+			{
+				for (int32 x = 0; x < volumeWidth; ++x)
+				{
+					image[y][x] = voxelColor(&buffer[y * rowBytes + x * voxelSize]);
+				}
+			}
+		}
+		break;
+	}
+	case LayerType::Y:
+	{
+		//y 一定の面は z ごとに1行ずつ読む
+		for (const size_t entryIndex : entryIndices)
+		{
+			const int32 sliceIndex = pool[entryIndex].sliceIndex;
+			Image& image = pool[entryIndex].layer->getImage();
+			for (int32 z = 0; z < volumeDepth; ++z)
+			{
+				readBytes((static_cast<int64>(z) * volumeHeight + sliceIndex) * rowBytes, rowBytes);
+				for (int32 x = 0; x < volumeWidth; ++x)
+				{
+					image[z][x] = voxelColor(&buffer[x * voxelSize]);
+				}
+			}
+		}
+		break;
+	}
+	default:
+	{
+		//x 一定の面はファイル上で1行ずつ離れているので、z ごとに読み込むスライスすべての列を含む範囲を1回で読んで、各スライスの列を取り出す
+		int32 minX = volumeWidth;
+		int32 maxX = -1;
+		for (const size_t entryIndex : entryIndices)
+		{
+			minX = Min(minX, pool[entryIndex].sliceIndex);
+			maxX = Max(maxX, pool[entryIndex].sliceIndex);
+		}
+
+		const size_t spanBytes = (volumeHeight - 1) * rowBytes + (maxX - minX + 1) * voxelSize;
+		for (int32 z = 0; z < volumeDepth; ++z)
+		{
+			readBytes(static_cast<int64>(z) * volumeHeight * rowBytes + minX * voxelSize, spanBytes);
+			for (const size_t entryIndex : entryIndices)
+			{
+				const size_t columnOffset = (pool[entryIndex].sliceIndex - minX) * voxelSize;
+				Image& image = pool[entryIndex].layer->getImage();
+				for (int32 y = 0; y < volumeHeight; ++y)
+				{
+					image[y][z] = voxelColor(&buffer[y * rowBytes + columnOffset]);
+				}
+			}
+		}
+		break;
+	}
+	}
+
+	for (const size_t entryIndex : entryIndices)
+	{
+		pool[entryIndex].layer->markDirty();
+	}
 }
@@ -16,7 +16,7 @@ void Main()
 	const int margin = 100;
 	const auto gridLayerSize = Point::One() * (200 * 2 + 150);
 	auto pLayerFloor = quarterView.newLayer(gridLayerSize + Size(margin, margin) * 2, LayerType::Y);
-	pLayerFloor->drawGroup = -1;
+	pLayerFloor->setDrawGroup(-1);
 	pLayerFloor->setPosition(Vec2(-margin, -margin));
 
 	quarterView.focus(*pLayerFloor);
@@ -46,21 +46,27 @@ void Main()
 
 	const double maxElevation = 50.0;
 
+	// 400ms かけて持ち上がり、しばらく留まってから下りる動きを繰り返す
+	QuarterTimeline bounce;
+	bounce.elevation(0.0, 0.0)
+		.elevation(0.4, maxElevation)
+		.elevation(1.6, maxElevation)
+		.elevation(2.0, 0.0)
+		.elevation(3.2, 0.0);
+	bounce.loop = true;
+
+	Stopwatch watch(true);
 	while (System::Update())
 	{
 		quarterView.update();
 
+		// レイヤーごとに 0.3 秒ずつ遅らせて再生する
+		bounce.apply(layers, watch.sF(), 0.3);
+
 		for (auto [i, pLayer] : Indexed(layers))
 		{
 			const double elevation01 = Math::InvLerp(0.0, maxElevation, pLayer->getElevation());
 
-			// Elevation が動いている途中でなければ一定確率で動かす
-			if (!pLayer->isElevationMoving() && RandomBool(0.01))
-			{
-				// 目標とする Elevation を設定してその値まで 400ms かけてイージングしながら遷移する
-				pLayer->setTargetElevation(0.5 < elevation01 ? 0.0 : maxElevation, 400);
-			}
-
 			auto r = pLayer->render();
 
 			r.rect().draw(HSV(20 * i, 0.8, 0.8, elevation01));
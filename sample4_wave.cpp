@@ -33,8 +33,8 @@ void Main()
 
 	constexpr Size textureSize(300, 300);
 	const int layerSize = 40;
-	auto layersZ = Array<QuarterLayerPtr>::IndexedGenerate(layerSize,
-		[&](size_t i) { return quarterView.newLayer(textureSize, LayerType::Z, i * 300.0 / (layerSize - 1)); });
+	auto layersZ = quarterView.newLayers(layerSize, textureSize, LayerType::Z,
+		[&](size_t i, QuarterLayer& layer) { layer.setElevation(i * 300.0 / (layerSize - 1)); });
 
 	Array<QuarterLayerPtr> layersX({
 		quarterView.newLayer(textureSize, LayerType::X, 0.0),